@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,6 +34,123 @@ static uint64_t xorshift64(uint64_t *s) {
   return x;
 }
 
+/* Page picker: uniform over the working set, Zipf(s) when s > 0 with a
+ * shuffled rank so hot pages are spread over the file, or a cyclic walk
+ * over the working set, `stride` pages at a time (backward if negative).
+ * With chain > 1 each pick is followed by chain - 1 pages past the working
+ * set that always follow it, like the inner and leaf nodes under a key.
+ * scan_pct of the picks instead continue a one-pass scan over the pages
+ * past the working set. */
+typedef struct {
+  size_t n;
+  double *cdf;
+  uint64_t *perm;
+  int loop;
+  int64_t stride;
+  unsigned chain;
+  unsigned chain_pos;
+  uint64_t chain_key;
+  uint64_t next;
+  unsigned scan_pct;
+  size_t scan_len;
+  uint64_t scan_next;
+} picker_t;
+
+static void picker_init(picker_t *p, size_t n, double s, int loop, uint64_t seed) {
+  memset(p, 0, sizeof(*p));
+  p->n = n;
+  p->loop = loop;
+  p->stride = 1;
+  if (s <= 0.0 || loop) return;
+
+  p->cdf = (double*)malloc(n * sizeof(double));
+  p->perm = (uint64_t*)malloc(n * sizeof(uint64_t));
+  if (!p->cdf || !p->perm) {
+    fprintf(stderr, "fatal: out of memory\n");
+    exit(2);
+  }
+
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sum += 1.0 / pow((double)(i + 1), s);
+    p->cdf[i] = sum;
+  }
+  for (size_t i = 0; i < n; i++) {
+    p->cdf[i] /= sum;
+    p->perm[i] = i;
+  }
+  for (size_t i = n; i > 1; i--) {
+    size_t j = (size_t)(xorshift64(&seed) % i);
+    uint64_t t = p->perm[i - 1];
+    p->perm[i - 1] = p->perm[j];
+    p->perm[j] = t;
+  }
+}
+
+static uint64_t picker_pick(picker_t *p, uint64_t *seed);
+
+static uint64_t picker_next(picker_t *p, uint64_t *seed) {
+  if (p->chain > 1 && p->scan_len) {
+    if (p->chain_pos == 0) p->chain_key = picker_pick(p, seed);
+    uint64_t page = p->chain_key;
+    if (p->chain_pos > 0) {
+      uint64_t h = (p->chain_key + 1) * 0x9e3779b97f4a7c15ULL + p->chain_pos;
+      page = p->n + xorshift64(&h) % p->scan_len;
+    }
+    p->chain_pos = (p->chain_pos + 1) % p->chain;
+    return page;
+  }
+  return picker_pick(p, seed);
+}
+
+static uint64_t picker_pick(picker_t *p, uint64_t *seed) {
+  if (p->scan_pct && p->scan_len && xorshift64(seed) % 100 < p->scan_pct) {
+    return p->n + p->scan_next++ % p->scan_len;
+  }
+  if (p->loop) {
+    uint64_t cur = p->next;
+    int64_t step = p->stride % (int64_t)p->n;
+    p->next = (p->next + p->n + (uint64_t)step) % p->n;
+    return cur;
+  }
+
+  uint64_t r = xorshift64(seed);
+  if (!p->cdf) return r % p->n;
+
+  double u = (double)(r >> 11) / (double)(1ULL << 53);
+  size_t lo = 0, hi = p->n - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (p->cdf[mid] < u) lo = mid + 1;
+    else hi = mid;
+  }
+  return p->perm[lo];
+}
+
+/* Pre-draw the whole trace so each read can announce when its page is read
+ * next (op index, ~0 if never) through vtpc_advice. */
+static void make_trace(picker_t *p, uint64_t *seed, size_t ops, size_t file_pages,
+                       uint64_t **trace_out, uint64_t **next_out) {
+  uint64_t *trace = (uint64_t*)malloc(ops * sizeof(uint64_t));
+  uint64_t *next = (uint64_t*)malloc(ops * sizeof(uint64_t));
+  uint64_t *last = (uint64_t*)malloc(file_pages * sizeof(uint64_t));
+  if (!trace || !next || !last) {
+    fprintf(stderr, "fatal: out of memory\n");
+    exit(2);
+  }
+
+  for (size_t i = 0; i < ops; i++) trace[i] = picker_next(p, seed);
+  for (size_t i = 0; i < file_pages; i++) last[i] = ~(uint64_t)0;
+  for (size_t i = ops; i > 0; i--) {
+    next[i - 1] = last[trace[i - 1]];
+    last[trace[i - 1]] = i - 1;
+  }
+
+  free(last);
+  *trace_out = trace;
+  *next_out = next;
+}
+
 static double now_sec(void) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -102,12 +220,24 @@ static void fill_file_if_needed(const char *path, size_t file_pages) {
 static void usage(const char *argv0) {
   fprintf(stderr,
     "Usage:\n"
-    "  %s --mode=libc|vtpc|none --file=PATH --file-pages=N --ws-pages=N --ops=N [--seed=N]\n\n"
+    "  %s --mode=libc|vtpc|none --file=PATH --file-pages=N --ws-pages=N --ops=N [--seed=N] [--zipf=S|--loop|--stride=K]\n"
+    "          [--chain=L] [--scan-pct=P] [--hints]\n\n"
+    "Pages are picked uniformly from the working set, Zipf-distributed\n"
+    "with exponent S when --zipf is given, or in order, cyclically, with\n"
+    "--loop, or K pages apart (backward if K < 0), cyclically, with\n"
+    "--stride. --chain=L follows every pick with L - 1 pages that always\n"
+    "come after it. With --scan-pct, P%% of the reads instead walk once through\n"
+    "the pages past the working set, like a log tail or compaction.\n"
+    "--hints (vtpc mode) passes each page's next use to vtpc_advice, for\n"
+    "VTPC_POLICY=opt.\n\n"
     "Modes:\n"
     "  libc : stdio (system page cache ON)\n"
-    "  vtpc : user 2Q cache, system cache OFF\n"
+    "  vtpc : user cache, system cache OFF\n"
     "  none : no user cache, system cache OFF\n\n"
-    "For vtpc cache size set env: VTPC_CACHE_PAGES (default 256).\n",
+    "For vtpc cache size set env: VTPC_CACHE_PAGES (default 256).\n"
+    "For vtpc replacement policy set env: VTPC_POLICY (default 2q).\n"
+    "For vtpc admission filter set env: VTPC_ADMISSION (all or tinylfu).\n"
+    "For vtpc prefetcher set env: VTPC_PREFETCH (stride, markov or none).\n",
     argv0
   );
   exit(1);
@@ -120,6 +250,12 @@ int main(int argc, char **argv) {
   size_t ws_pages = 256;
   size_t ops = 500000;
   uint64_t seed = 1;
+  double zipf = 0.0;
+  int loop = 0;
+  int64_t stride = 0;
+  unsigned chain = 0;
+  unsigned scan_pct = 0;
+  int hints = 0;
 
   for (int i = 1; i < argc; i++) {
     if (strncmp(argv[i], "--mode=", 7) == 0) mode = argv[i] + 7;
@@ -128,6 +264,12 @@ int main(int argc, char **argv) {
     else if (strncmp(argv[i], "--ws-pages=", 11) == 0) ws_pages = (size_t)strtoull(argv[i] + 11, NULL, 10);
     else if (strncmp(argv[i], "--ops=", 6) == 0) ops = (size_t)strtoull(argv[i] + 6, NULL, 10);
     else if (strncmp(argv[i], "--seed=", 7) == 0) seed = (uint64_t)strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--zipf=", 7) == 0) zipf = strtod(argv[i] + 7, NULL);
+    else if (strcmp(argv[i], "--loop") == 0) loop = 1;
+    else if (strncmp(argv[i], "--stride=", 9) == 0) stride = strtoll(argv[i] + 9, NULL, 10);
+    else if (strncmp(argv[i], "--chain=", 8) == 0) chain = (unsigned)strtoul(argv[i] + 8, NULL, 10);
+    else if (strcmp(argv[i], "--hints") == 0) hints = 1;
+    else if (strncmp(argv[i], "--scan-pct=", 11) == 0) scan_pct = (unsigned)strtoul(argv[i] + 11, NULL, 10);
     else usage(argv[0]);
   }
 
@@ -137,9 +279,26 @@ int main(int argc, char **argv) {
   size_t ps = page_size();
   fill_file_if_needed(path, file_pages);
 
+  picker_t picker;
+  if (stride) loop = 1;
+  picker_init(&picker, ws_pages, zipf, loop, seed ^ 0x5bd1e995);
+  if (stride) {
+    picker.stride = stride;
+    if (stride < 0) picker.next = ws_pages - 1;
+  }
+  picker.scan_pct = (scan_pct > 100) ? 100 : scan_pct;
+  picker.chain = chain;
+  picker.scan_len = file_pages - ws_pages;
+
+  uint64_t *trace = NULL, *next_use = NULL;
+  if (hints) make_trace(&picker, &seed, ops, file_pages, &trace, &next_use);
+
   void *buf = NULL;
   if (posix_memalign(&buf, ps, ps) != 0) die("posix_memalign buf");
 
+  vtpc_stats st;
+  memset(&st, 0, sizeof(st));
+
   double t0 = now_sec();
 
   /* ---------------- libc (system cache ON) ---------------- */
@@ -149,8 +308,7 @@ int main(int argc, char **argv) {
     if (!f) die("fopen libc");
 
     for (size_t i = 0; i < ops; i++) {
-      uint64_t r = xorshift64(&seed);
-      uint64_t page = (r % ws_pages);
+      uint64_t page = picker_next(&picker, &seed);
       off_t off = (off_t)(page * ps);
 
       if (fseeko(f, off, SEEK_SET) != 0) die("fseeko libc");
@@ -171,8 +329,7 @@ int main(int argc, char **argv) {
 #endif
 
     for (size_t i = 0; i < ops; i++) {
-      uint64_t r = xorshift64(&seed);
-      uint64_t page = (r % ws_pages);
+      uint64_t page = picker_next(&picker, &seed);
       off_t off = (off_t)(page * ps);
 
       ssize_t n = pread(fd, buf, ps, off);
@@ -189,16 +346,17 @@ int main(int argc, char **argv) {
     if (fd < 0) die("vtpc_open");
 
     for (size_t i = 0; i < ops; i++) {
-      uint64_t r = xorshift64(&seed);
-      uint64_t page = (r % ws_pages);
+      uint64_t page = trace ? trace[i] : picker_next(&picker, &seed);
       off_t off = (off_t)(page * ps);
 
       if (vtpc_lseek(fd, off, SEEK_SET) < 0) die("vtpc_lseek");
       ssize_t n = vtpc_read(fd, buf, ps);
       if (n < 0) die("vtpc_read");
       if ((size_t)n != ps) die("short vtpc_read");
+      if (trace && vtpc_advice(fd, off, ps, next_use[i]) != 0) die("vtpc_advice");
     }
 
+    if (vtpc_get_stats(fd, &st) != 0) die("vtpc_get_stats");
     vtpc_close(fd);
 
   } else {
@@ -213,11 +371,31 @@ int main(int argc, char **argv) {
   double mbps = mb / dt;
   double ops_s = (double)ops / dt;
 
-  printf("mode=%s file_pages=%zu ws_pages=%zu ops=%zu page_size=%zu\n",
-         mode, file_pages, ws_pages, ops, ps);
+  printf("mode=%s file_pages=%zu ws_pages=%zu ops=%zu page_size=%zu zipf=%.2f loop=%d scan_pct=%u\n",
+         mode, file_pages, ws_pages, ops, ps, zipf, loop, picker.scan_pct);
   printf("time_sec=%.6f throughput_mib_s=%.2f ops_s=%.2f\n",
          dt, mbps, ops_s);
+  if (st.policy) {
+    unsigned long long lookups = st.hits + st.misses;
+    printf("policy=%s hits=%llu misses=%llu hit_ratio=%.4f\n",
+           st.policy, st.hits, st.misses,
+           lookups ? (double)st.hits / (double)lookups : 0.0);
+    if (st.kin) printf("kin=%zu kout=%zu\n", st.kin, st.kout);
+    if (st.prefetches) printf("prefetches=%llu prefetch_hits=%llu\n", st.prefetches, st.prefetch_hits);
+    static const char *const classes[] = {"unknown", "sequential", "strided",
+                                          "random", "looping", "write-once"};
+    printf("access=%s bypass_admits=%llu ring_fills=%llu\n", classes[st.access], st.bypass_admits,
+           st.ring_fills);
+    if (st.markov_prefetches) {
+      printf("markov_prefetches=%llu markov_hits=%llu coverage=%.4f active=%d\n",
+             st.markov_prefetches, st.markov_hits, st.markov_coverage, st.markov_active);
+    }
+  }
 
+  free(trace);
+  free(next_use);
+  free(picker.cdf);
+  free(picker.perm);
   free(buf);
   return 0;
 }
\ No newline at end of file
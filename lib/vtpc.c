@@ -5,11 +5,22 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <linux/userfaultfd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#include <time.h>
 #include <unistd.h>
 #ifdef __APPLE__
 #ifndef O_DIRECT
@@ -21,10 +32,67 @@
 #define VTPC_MAX_HANDLES 1024
 #endif
 
+#ifndef VTPC_MAX_POOLS
+#define VTPC_MAX_POOLS 64
+#endif
+
 #ifndef VTPC_DEFAULT_CACHE_PAGES
 #define VTPC_DEFAULT_CACHE_PAGES 256
 #endif
 
+#ifndef VTPC_MIN_BLOCK_SIZE
+#define VTPC_MIN_BLOCK_SIZE 512
+#endif
+
+#ifndef VTPC_MAX_BLOCK_SIZE
+#define VTPC_MAX_BLOCK_SIZE (8u << 20)
+#endif
+
+/* bounded by the width of page_entry_t.dirty */
+#define VTPC_MAX_EXTENT_PAGES 64
+
+#define VTPC_LRUK_MAX_K 4
+
+/* Stride prefetcher look-ahead, in runs, and the first value for a handle */
+#define VTPC_PREFETCH_MAX_DEPTH 64
+#define VTPC_PREFETCH_DEPTH 4
+/* Largest single read covering several strided runs */
+#define VTPC_PREFETCH_SPAN (1u << 20)
+
+/* Markov prefetcher: successor table slots per cache block (the table
+ * outlives evictions), its bounds, and how far a chain is followed */
+#define VTPC_MARKOV_SLOTS_PER_BLOCK 8
+#define VTPC_MARKOV_MIN_SLOTS 1024
+#define VTPC_MARKOV_MAX_SLOTS (1u << 18)
+#define VTPC_MARKOV_DEPTH 3
+
+/* Access classification: block transitions per verdict */
+#define VTPC_CLASS_WINDOW 64
+
+/* Extent buffers in the ring of a streaming handle */
+#define VTPC_RING_SLOTS 4
+
+/* vtpc_read_batch: missed runs up to VTPC_BATCH_GAP bytes apart are read
+ * as one, up to VTPC_BATCH_READ bytes per read; lookups probe the resident
+ * table VTPC_BATCH_LOOKAHEAD blocks ahead */
+#define VTPC_BATCH_GAP (32u << 10)
+#define VTPC_BATCH_READ (1u << 20)
+#define VTPC_BATCH_LOOKAHEAD 8
+
+/* Threads reading for vtpc_fadvise(WILLNEED), started on first use */
+#ifndef VTPC_FILL_WORKERS
+#define VTPC_FILL_WORKERS 4
+#endif
+
+/* Cache page numbers carry the handle slot above VTPC_TAG_SHIFT, so files
+ * sharing a pool never collide; the low bits are the block in the file. */
+#define VTPC_TAG_SHIFT 48
+#define VTPC_FILE_PAGE_MASK (((uint64_t)1 << VTPC_TAG_SHIFT) - 1)
+
+#if VTPC_MAX_HANDLES > 65536
+#error "VTPC_MAX_HANDLES does not fit the page number tag"
+#endif
+
 
 
 static size_t vtpc_page_size(void) {
@@ -39,6 +107,33 @@ static size_t next_pow2(size_t x) {
   return p;
 }
 
+static int is_pow2(size_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+static unsigned log2_sz(size_t x) {
+  unsigned s = 0;
+  while (((size_t)1 << s) < x) s++;
+  return s;
+}
+
+/* "65536", "64k", "4M" */
+static int parse_size(const char *s, size_t *out) {
+  if (!s || !*s) return -1;
+  char *end = NULL;
+  unsigned long long v = strtoull(s, &end, 10);
+  if (end == s) return -1;
+  if (*end == 'k' || *end == 'K') { v <<= 10; end++; }
+  else if (*end == 'm' || *end == 'M') { v <<= 20; end++; }
+  if (*end != '\0') return -1;
+  *out = (size_t)v;
+  return 0;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
 static uint64_t hash_u64(uint64_t x) {
 
   x += 0x9e3779b97f4a7c15ULL;
@@ -53,6 +148,8 @@ static size_t max_sz(size_t a, size_t b) { return (a > b) ? a : b; }
 
 typedef struct {
   size_t cap;       
+  size_t used;      /* live keys */
+  size_t tombs;     /* deleted slots still breaking probe chains */
   uint64_t *keys;
   void **vals;
   uint8_t *state;  
@@ -60,6 +157,8 @@ typedef struct {
 
 static int ht_init(ht_t *t, size_t cap_pow2) {
   t->cap = cap_pow2;
+  t->used = 0;
+  t->tombs = 0;
   t->keys = (uint64_t*)calloc(t->cap, sizeof(uint64_t));
   t->vals = (void**)calloc(t->cap, sizeof(void*));
   t->state = (uint8_t*)calloc(t->cap, sizeof(uint8_t));
@@ -79,6 +178,14 @@ static void ht_destroy(ht_t *t) {
   memset(t, 0, sizeof(*t));
 }
 
+/* Start loading the slot a lookup of key probes first. */
+static void ht_prefetch(const ht_t *t, uint64_t key) {
+  if (t->cap == 0) return;
+  size_t i = (size_t)(hash_u64(key) & (t->cap - 1));
+  __builtin_prefetch(&t->state[i]);
+  __builtin_prefetch(&t->keys[i]);
+}
+
 static void* ht_get(const ht_t *t, uint64_t key) {
   if (t->cap == 0) return NULL;
   size_t mask = t->cap - 1;
@@ -91,6 +198,31 @@ static void* ht_get(const ht_t *t, uint64_t key) {
   }
 }
 
+static void ht_insert_fresh(ht_t *t, uint64_t key, void *val) {
+  size_t mask = t->cap - 1;
+  size_t i = (size_t)(hash_u64(key) & mask);
+  while (t->state[i] != 0) i = (i + 1) & mask;
+  t->state[i] = 1;
+  t->keys[i] = key;
+  t->vals[i] = val;
+  t->used++;
+}
+
+/* Rebuild without tombstones; grows when live keys pass half the table. */
+static int ht_rehash(ht_t *t) {
+  size_t cap = t->cap;
+  while ((t->used + 1) * 2 > cap) cap <<= 1;
+
+  ht_t n;
+  if (ht_init(&n, cap) != 0) return -1;
+  for (size_t i = 0; i < t->cap; i++) {
+    if (t->state[i] == 1) ht_insert_fresh(&n, t->keys[i], t->vals[i]);
+  }
+  ht_destroy(t);
+  *t = n;
+  return 0;
+}
+
 static int ht_put(ht_t *t, uint64_t key, void *val) {
   size_t mask = t->cap - 1;
   size_t i = (size_t)(hash_u64(key) & mask);
@@ -99,10 +231,18 @@ static int ht_put(ht_t *t, uint64_t key, void *val) {
   for (;;) {
     uint8_t st = t->state[i];
     if (st == 0) {
-      size_t idx = (first_tomb != (size_t)-1) ? first_tomb : i;
-      t->state[idx] = 1;
-      t->keys[idx] = key;
-      t->vals[idx] = val;
+      if (first_tomb != (size_t)-1) {
+        i = first_tomb;
+        t->tombs--;
+      } else if ((t->used + t->tombs + 1) * 4 > t->cap * 3) {
+        if (ht_rehash(t) != 0) return -1;
+        ht_insert_fresh(t, key, val);
+        return 0;
+      }
+      t->state[i] = 1;
+      t->keys[i] = key;
+      t->vals[i] = val;
+      t->used++;
       return 0;
     }
     if (st == 2 && first_tomb == (size_t)-1) first_tomb = i;
@@ -123,6 +263,8 @@ static void ht_del(ht_t *t, uint64_t key) {
     if (st == 1 && t->keys[i] == key) {
       t->state[i] = 2;
       t->vals[i] = NULL;
+      t->used--;
+      t->tombs++;
       return;
     }
     i = (i + 1) & mask;
@@ -130,64 +272,406 @@ static void ht_del(ht_t *t, uint64_t key) {
 }
 
 
-typedef enum {
-  Q_A1IN = 1,
-  Q_AM = 2
-} page_queue_t;
+/* Count-min frequency sketch for TinyLFU admission: 4-bit counters packed
+ * sixteen to a word, four probes per key, two bytes per cached block.
+ * Every `sample` increments all counters are halved so old popularity
+ * fades. */
+typedef struct {
+  uint64_t *table;
+  size_t mask;            /* counters - 1 */
+  size_t adds;
+  size_t sample;
+} sketch_t;
+
+static int sketch_init(sketch_t *k, size_t blocks) {
+  size_t counters = max_sz(next_pow2(blocks * 4), 64);
+  k->table = (uint64_t*)calloc(counters / 16, sizeof(uint64_t));
+  if (!k->table) { errno = ENOMEM; return -1; }
+  k->mask = counters - 1;
+  k->adds = 0;
+  k->sample = blocks * 10;
+  return 0;
+}
+
+static void sketch_destroy(sketch_t *k) {
+  free(k->table);
+  k->table = NULL;
+}
+
+static size_t sketch_index(const sketch_t *k, uint64_t h, unsigned i) {
+  return ((size_t)(uint32_t)h + i * (size_t)((h >> 32) | 1)) & k->mask;
+}
+
+static unsigned sketch_estimate(const sketch_t *k, uint64_t key) {
+  uint64_t h = hash_u64(key);
+  unsigned est = 15;
+  for (unsigned i = 0; i < 4; i++) {
+    size_t idx = sketch_index(k, h, i);
+    unsigned v = (unsigned)(k->table[idx >> 4] >> ((idx & 15) << 2)) & 15;
+    est = (v < est) ? v : est;
+  }
+  return est;
+}
+
+static void sketch_add(sketch_t *k, uint64_t key) {
+  uint64_t h = hash_u64(key);
+  for (unsigned i = 0; i < 4; i++) {
+    size_t idx = sketch_index(k, h, i);
+    unsigned shift = (unsigned)(idx & 15) << 2;
+    uint64_t v = (k->table[idx >> 4] >> shift) & 15;
+    k->table[idx >> 4] += (uint64_t)(v < 15) << shift;
+  }
+
+  if (++k->adds >= k->sample) {
+    for (size_t w = 0; w <= k->mask >> 4; w++) {
+      k->table[w] = (k->table[w] >> 1) & 0x7777777777777777ULL;
+    }
+    k->adds /= 2;
+  }
+}
+
+
+/* Link for a second policy list that can hold resident and ghost entries
+ * alike (the LIRS stack). */
+typedef struct vtpc_link {
+  struct vtpc_link *prev;
+  struct vtpc_link *next;
+  uint8_t ghost;
+  uint8_t linked;
+} vtpc_link_t;
+
+#define container_of(ptr, type, member) \
+  ((type*)((char*)(ptr) - offsetof(type, member)))
+
+/* A resident extent: npages contiguous cache pages starting at page_no,
+ * one buffer, one list node. Every page of it is a key in `resident`.
+ * q, ref and the prev/next links belong to the replacement policy. */
+struct vtpc_handle;
+
+enum { PF_STRIDE = 1, PF_MARKOV = 2, PF_ADVISED = 3 };
+enum { SIDE_STREAM = 1, SIDE_LOOP = 2, SIDE_PIN = 3 };
 
 typedef struct page_entry {
-  uint64_t page_no;
+  uint64_t page_no;       /* tagged, see VTPC_TAG_SHIFT */
+  uint32_t npages;
+  uint8_t q;
+  uint8_t ref;
+  uint8_t win;            /* in the admission window, not yet in the policy */
+  uint8_t pf;             /* prefetched (PF_*) and not read yet */
+  uint8_t side;           /* on a side queue (SIDE_*) or pinned, not in the policy */
+  uint32_t pins;          /* vtpc_pin calls holding it */
   void *data;             
-  size_t valid_len;      
-  int dirty;              
-  page_queue_t q;
+  size_t valid_len;       /* bytes from the extent start */
+  uint64_t dirty;         /* bit i: page page_no + i needs write-back */
 
   struct page_entry *prev;
   struct page_entry *next;
+  vtpc_link_t aux;
+  uint64_t key;           /* priority for policies that keep a heap */
+  size_t heap_idx;
+  struct vtpc_handle *owner;
+  struct page_entry *all_prev;   /* every entry of the owner, for flush/close */
+  struct page_entry *all_next;
 } page_entry_t;
 
+/* History of an evicted extent, indexed like resident ones in `ghosts`.
+ * Which list it sits on, and for how long, is up to the policy. */
 typedef struct ghost_entry {
   uint64_t page_no;
+  uint32_t npages;
+  uint8_t q;
+  uint64_t stamp;         /* policy-defined age */
   struct ghost_entry *prev;
   struct ghost_entry *next;
+  vtpc_link_t aux;
 } ghost_entry_t;
 
-typedef struct vtpc_cache {
-  size_t page_size;
+/* Indexed binary min-heap of resident entries ordered by key. Each entry
+ * remembers its slot so it can be removed or re-keyed in O(log n). */
+typedef struct {
+  page_entry_t **a;
+  size_t n;
+  size_t cap;
+} heap_t;
+
+static void heap_set(heap_t *hp, size_t i, page_entry_t *p) {
+  hp->a[i] = p;
+  p->heap_idx = i;
+}
+
+static void heap_sift_up(heap_t *hp, size_t i) {
+  page_entry_t *p = hp->a[i];
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (hp->a[parent]->key <= p->key) break;
+    heap_set(hp, i, hp->a[parent]);
+    i = parent;
+  }
+  heap_set(hp, i, p);
+}
 
-  size_t capacity;        
-  size_t kin;             
-  size_t kout;           
-  size_t am_cap;          
+static void heap_sift_down(heap_t *hp, size_t i) {
+  page_entry_t *p = hp->a[i];
+  for (;;) {
+    size_t l = 2 * i + 1;
+    if (l >= hp->n) break;
+    size_t m = (l + 1 < hp->n && hp->a[l + 1]->key < hp->a[l]->key) ? l + 1 : l;
+    if (p->key <= hp->a[m]->key) break;
+    heap_set(hp, i, hp->a[m]);
+    i = m;
+  }
+  heap_set(hp, i, p);
+}
+
+/* Room for n entries. A policy that keeps every entry it owns in a heap
+ * reserves one per cache block, plus one: an entry holds a block at least,
+ * and only pinned blocks can push the cache past its capacity, by the one
+ * extent loaded while nothing else could go. heap_push then never fails. */
+static int heap_reserve(heap_t *hp, size_t n) {
+  if (n <= hp->cap) return 0;
+  page_entry_t **a = (page_entry_t**)realloc(hp->a, n * sizeof(*a));
+  if (!a) { errno = ENOMEM; return -1; }
+  hp->a = a;
+  hp->cap = n;
+  return 0;
+}
 
-  size_t a1in_sz;
-  size_t am_sz;
-  size_t a1out_sz;
+static int heap_push(heap_t *hp, page_entry_t *p) {
+  if (hp->n == hp->cap) {
+    size_t cap = hp->cap ? hp->cap * 2 : 64;
+    page_entry_t **a = (page_entry_t**)realloc(hp->a, cap * sizeof(*a));
+    if (!a) { errno = ENOMEM; return -1; }
+    hp->a = a;
+    hp->cap = cap;
+  }
+  heap_set(hp, hp->n++, p);
+  heap_sift_up(hp, hp->n - 1);
+  return 0;
+}
 
-  page_entry_t *a1in_head, *a1in_tail; 
-  page_entry_t *am_head, *am_tail;     
-  ghost_entry_t *a1out_head, *a1out_tail; 
+static void heap_remove(heap_t *hp, page_entry_t *p) {
+  size_t i = p->heap_idx;
+  page_entry_t *last = hp->a[--hp->n];
+  if (i == hp->n) return;
+  heap_set(hp, i, last);
+  heap_sift_up(hp, i);
+  heap_sift_down(hp, last->heap_idx);
+}
+
+/* Restore order after p->key changed. */
+static void heap_update(heap_t *hp, page_entry_t *p) {
+  heap_sift_up(hp, p->heap_idx);
+  heap_sift_down(hp, p->heap_idx);
+}
+
+static page_entry_t* heap_top(const heap_t *hp) {
+  return hp->n ? hp->a[0] : NULL;
+}
+
+static void heap_destroy(heap_t *hp) {
+  free(hp->a);
+  memset(hp, 0, sizeof(*hp));
+}
+
+typedef struct vtpc_cache vtpc_cache_t;
+
+/* Replacement policy. The cache owns the buffers and both indexes; the
+ * policy owns the queues. Sizes passed around are in bytes.
+ *
+ *   on_hit        - a resident entry was referenced
+ *   on_ghost_hit  - a miss hit history; returns an admission hint (usually
+ *                   the ghost's queue) for choose_victim/on_miss. The ghost
+ *                   is forgotten right after.
+ *   choose_victim - entry to evict next, still linked; NULL if none. It may
+ *                   reorder the policy's own queues while searching.
+ *   on_evict      - unlink the victim, optionally remember it as a ghost
+ *   remove        - unlink an entry that stays resident (pinned): no ghost,
+ *                   and history and tuning state are left as they are
+ *   on_miss       - link a freshly loaded entry (admission)
+ *   forget_ghost  - unlink a ghost the cache is about to free
+ *   forget_slot   - optional, drop the history other than ghosts kept for
+ *                   the blocks of a pool slot whose handle closed
+ *   advise        - optional, next-use hint for npages blocks at page_no
+ *   stats         - optional, fill the policy-specific vtpc_stats fields */
+typedef struct vtpc_policy_ops {
+  const char *name;
+  int (*init)(vtpc_cache_t *c, const vtpc_opts *o);
+  void (*destroy)(vtpc_cache_t *c);
+  void (*on_hit)(vtpc_cache_t *c, page_entry_t *p);
+  int (*on_ghost_hit)(vtpc_cache_t *c, ghost_entry_t *g);
+  page_entry_t* (*choose_victim)(vtpc_cache_t *c, int hint);
+  void (*on_evict)(vtpc_cache_t *c, page_entry_t *p);
+  void (*remove)(vtpc_cache_t *c, page_entry_t *p);
+  void (*on_miss)(vtpc_cache_t *c, page_entry_t *p, int hint);
+  void (*forget_ghost)(vtpc_cache_t *c, ghost_entry_t *g);
+  void (*forget_slot)(vtpc_cache_t *c, uint64_t key_base);
+  void (*advise)(vtpc_cache_t *c, uint64_t page_no, uint64_t npages, uint64_t when);
+  void (*stats)(const vtpc_cache_t *c, vtpc_stats *st);
+} vtpc_policy_ops;
+
+/* All sizes and budgets are in bytes so extents of different lengths share
+ * one capacity. */
+struct vtpc_cache {
+  size_t page_size;       /* cache block size, power of two */
+  unsigned page_shift;
+  size_t page_mask;
+
+  size_t capacity;        
+  size_t used;            /* bytes of resident extents */
+
+  int pool;               /* vtpc_pool_create id, 0 for a private cache */
+  size_t refs;            /* handles using the cache */
 
   ht_t resident;        
   ht_t ghosts;            
-} vtpc_cache_t;
-
 
+  const vtpc_policy_ops *pol;
+  void *pol_state;
+  uint64_t op_seq;        /* vtpc_read/vtpc_write calls so far */
+  uint8_t op_write;       /* the current call is a vtpc_write */
+
+  /* TinyLFU admission: new extents wait in a small LRU window and only
+   * enter the policy if they are more popular than its next victim. */
+  int tinylfu;
+  sketch_t sketch;
+  page_entry_t *win_head, *win_tail;
+  size_t win_used;
+  size_t win_cap;
+
+  /* Side queues for handles classified as streams (evicted first, oldest
+   * first) and loops (newest first once over half the cache) */
+  page_entry_t *stream_head, *stream_tail;
+  page_entry_t *loop_head, *loop_tail;
+  size_t loop_used;
+
+  /* Pinned entries sit on no queue at all */
+  size_t pinned;
+  size_t pin_cap;
+
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t ghost_hits;
+  uint64_t evictions;
+  uint64_t writebacks;
+  uint64_t admit_rejects;
+};
+
+
+
+/* Successors seen after a run that started at `page`, counts saturating at
+ * 15; a new successor takes the weaker spot once its count has decayed to
+ * zero. Pages are untagged and stored +1 so that 0 marks an empty slot. */
+typedef struct markov_slot {
+  uint64_t page;
+  uint64_t next[2];
+  uint8_t len[2];          /* blocks in that successor run */
+  uint8_t count[2];
+} markov_slot_t;
+
+/* One extent read by a streaming handle outside the cache. */
+typedef struct ring_slot {
+  uint64_t page_no;        /* tagged, as for page_entry_t */
+  uint32_t npages;         /* 0: empty */
+  uint8_t *data;
+} ring_slot_t;
 
 typedef struct vtpc_handle {
   int used;
   int os_fd;
   int flags;             
   int direct;            
+  size_t dio_align;      /* smallest block size this fd accepts */
   off_t pos;
   off_t size;            
 
-  vtpc_cache_t cache;
+  vtpc_opts opts;        /* resolved; capacity 0 = VTPC_CACHE_PAGES blocks */
+  size_t ra_pages;       /* current adaptive extent length */
+  uint64_t ra_next;      /* page right after the last loaded extent */
+  page_entry_t *last_ent; /* entry of the last lookup; may be gone, never read */
+  uint64_t last_page;    /* and its page */
+
+  /* stride detector, over untagged page numbers */
+  uint64_t pf_run_start;  /* first page of the current run of consecutive pages */
+  uint64_t pf_run_end;    /* page after its last */
+  uint8_t pf_jump;        /* the last page seen started a new run */
+  int64_t pf_stride;      /* distance between the last two run starts */
+  unsigned pf_conf;       /* runs in a row at that distance */
+  unsigned pf_depth;      /* runs to keep loaded ahead */
+  uint8_t *pf_span;       /* VTPC_PREFETCH_SPAN bytes, allocated on first use */
+  uint64_t disk_gen;      /* bumped by every write-back of its blocks */
+  uint64_t prefetches;
+  uint64_t prefetch_hits;
+
+  struct markov_slot *mk;  /* successor table, VTPC_PREFETCH_MARKOV only */
+  size_t mk_mask;
+  uint64_t mk_prev;        /* start of the run before the current one, +1 */
+  uint64_t mk_win_hits;    /* outcomes of Markov prefetches this window */
+  uint64_t mk_win_wasted;
+  uint64_t mk_backoff;     /* runs left while switched off */
+  uint64_t mk_prefetches;
+  uint64_t mk_hits;
+  uint64_t misses;         /* this handle's demand misses */
+
+  /* access classifier, over the same runs */
+  vtpc_access cl;
+  unsigned cl_n;           /* transitions in the current window */
+  unsigned cl_seq;         /* ... that extended a run */
+  unsigned cl_write;       /* ... made by vtpc_write */
+  unsigned cl_new;         /* ... to a page past any seen before */
+  unsigned cl_reused;      /* stream blocks read again this window */
+  uint64_t cl_hw;          /* highest page seen, +1 */
+  uint64_t cl_ticks;       /* transitions so far */
+  uint64_t cl_loop_until;  /* looping while cl_ticks is below this */
+  uint64_t cl_loop_len;    /* blocks per pass */
+  uint64_t bypass_admits;
+
+  struct fill_job *fills;  /* background reads not installed yet */
+  uint64_t async_fills;
+  uint64_t async_stale;
+  const struct batch *batch;  /* during vtpc_read_batch: misses read ahead */
+  off_t resv_off;             /* vtpc_write_reserve's range until committed */
+  size_t resv_len;            /* 0: none */
+  uint64_t *resv_unread;      /* its blocks handed out zeroed, not read */
+  uint64_t batch_reads;
+  int noreuse;             /* POSIX_FADV_NOREUSE: misses are the first to go */
+  int nowait;              /* in a read that must not wait for the file */
+  int fill_err;            /* errno of a failed fill, for the next non-blocking read */
+  int efd;                 /* vtpc_eventfd, -1 until asked for; under g_fill.lock */
+  uint64_t nowait_misses;
+  int maps;                /* vtpc_mmap mappings of the handle */
+  uint64_t map_faults;
+  uint64_t scan_reads;
+
+  struct aio_req *aio;      /* vtpc_submit reads waiting for fills, oldest first */
+  struct aio_req *aio_tail;
+  size_t aio_n;
+  vtpc_event *events;       /* completions not reaped yet */
+  size_t nevents;
+  size_t events_cap;        /* covers every read in flight */
+
+  ring_slot_t *ring;       /* VTPC_RING_SLOTS, allocated when streaming starts */
+  size_t ring_pages;       /* capacity of each slot */
+  unsigned ring_next;      /* slot to refill next */
+  uint64_t ring_fills;
+
+  vtpc_cache_t *cache;   /* private, or shared with other handles of a pool */
+  uint64_t key_base;     /* slot tag of this handle's cache page numbers */
+  page_entry_t *all_head;
+  uint64_t fill_ns;      /* moving average of read latency per block */
+  uint64_t flush_ns;     /* moving average of write-back latency per block */
 } vtpc_handle_t;
 
 static vtpc_handle_t g_handles[VTPC_MAX_HANDLES];
+static vtpc_cache_t *g_pools[VTPC_MAX_POOLS];
 static int g_inited = 0;
 static size_t g_cfg_cache_pages = 0;
+static size_t g_cfg_block_size = 0;
+static size_t g_cfg_extent_pages = 0;
+static vtpc_policy g_cfg_policy = VTPC_POLICY_DEFAULT;
+static vtpc_admission g_cfg_admission = VTPC_ADMIT_ALL;
+static vtpc_prefetch g_cfg_prefetch = VTPC_PREFETCH_STRIDE;
+
+static vtpc_policy policy_by_name(const char *name);
 
 static void vtpc_init_once(void) {
   if (g_inited) return;
@@ -203,6 +687,31 @@ static void vtpc_init_once(void) {
   }
   if (g_cfg_cache_pages == 0) g_cfg_cache_pages = VTPC_DEFAULT_CACHE_PAGES;
 
+  size_t bs = 0;
+  if (parse_size(getenv("VTPC_BLOCK_SIZE"), &bs) == 0 && is_pow2(bs) &&
+      bs >= VTPC_MIN_BLOCK_SIZE && bs <= VTPC_MAX_BLOCK_SIZE) {
+    g_cfg_block_size = bs;
+  }
+  if (g_cfg_block_size == 0) g_cfg_block_size = vtpc_page_size();
+
+  size_t ext = 0;
+  if (parse_size(getenv("VTPC_EXTENT_PAGES"), &ext) == 0 && is_pow2(ext) &&
+      ext <= VTPC_MAX_EXTENT_PAGES) {
+    g_cfg_extent_pages = ext;
+  }
+
+  /* an unknown name stays DEFAULT, which opens that rely on it refuse */
+  env = getenv("VTPC_POLICY");
+  g_cfg_policy = policy_by_name(env);
+  if (!env || !*env) g_cfg_policy = VTPC_POLICY_2Q;
+
+  env = getenv("VTPC_ADMISSION");
+  if (env && strcasecmp(env, "tinylfu") == 0) g_cfg_admission = VTPC_ADMIT_TINYLFU;
+
+  env = getenv("VTPC_PREFETCH");
+  if (env && strcasecmp(env, "none") == 0) g_cfg_prefetch = VTPC_PREFETCH_NONE;
+  if (env && strcasecmp(env, "markov") == 0) g_cfg_prefetch = VTPC_PREFETCH_MARKOV;
+
   memset(g_handles, 0, sizeof(g_handles));
 }
 
@@ -240,13 +749,6 @@ static void page_list_push_front(page_entry_t **head, page_entry_t **tail, page_
   if (!*tail) *tail = p;
 }
 
-static page_entry_t* page_list_pop_back(page_entry_t **head, page_entry_t **tail) {
-  page_entry_t *p = *tail;
-  if (!p) return NULL;
-  page_list_remove(head, tail, p);
-  return p;
-}
-
 static void ghost_list_remove(ghost_entry_t **head, ghost_entry_t **tail, ghost_entry_t *g) {
   if (!g) return;
   if (g->prev) g->prev->next = g->next;
@@ -297,32 +799,53 @@ static ssize_t pwrite_fullpage(vtpc_handle_t *h, const void *buf, size_t page_si
 
 
 
-static int cache_init(vtpc_cache_t *c, size_t page_size) {
-  memset(c, 0, sizeof(*c));
-  c->page_size = page_size;
+static size_t dio_alignment(int fd, int direct) {
+  if (!direct) return VTPC_MIN_BLOCK_SIZE;
+#ifdef STATX_DIOALIGN
+  struct statx sx;
+  if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0 &&
+      (sx.stx_mask & STATX_DIOALIGN) && sx.stx_dio_offset_align > 0) {
+    return max_sz(sx.stx_dio_offset_align, VTPC_MIN_BLOCK_SIZE);
+  }
+#else
+  (void)fd;
+#endif
+  return vtpc_page_size();
+}
+
+static size_t buffer_alignment(size_t page_size) {
+  return min_sz(page_size, vtpc_page_size());
+}
 
-  c->capacity = g_cfg_cache_pages;
-  if (c->capacity < 4) c->capacity = 4;
+static off_t page_off(const vtpc_cache_t *c, uint64_t page_no) {
+  return (off_t)((page_no & VTPC_FILE_PAGE_MASK) << c->page_shift);
+}
 
-  c->kin = c->capacity / 4;
-  if (c->kin < 1) c->kin = 1;
-  if (c->kin >= c->capacity) c->kin = c->capacity / 2;
+/* Whether bytes [off, off + len) lie in blocks a page number can carry:
+ * past VTPC_FILE_PAGE_MASK the block would run into the slot tag. */
+static int range_fits(const vtpc_cache_t *c, uint64_t off, uint64_t len) {
+  uint64_t last = off + (len ? len - 1 : 0);
+  return last >= off && (last >> c->page_shift) <= VTPC_FILE_PAGE_MASK;
+}
 
-  c->am_cap = c->capacity - c->kin;
-  if (c->am_cap < 1) c->am_cap = 1;
+static uint64_t ewma_ns(uint64_t avg, uint64_t sample) {
+  return avg ? (avg * 7 + sample) / 8 : sample;
+}
 
-  c->kout = c->capacity / 2;
-  if (c->kout < 1) c->kout = 1;
+static size_t entry_bytes(const vtpc_cache_t *c, const page_entry_t *p) {
+  return (size_t)p->npages << c->page_shift;
+}
 
-  size_t resident_cap = next_pow2(c->capacity * 4);
-  size_t ghosts_cap = next_pow2(c->kout * 4);
+static size_t ghost_bytes(const vtpc_cache_t *c, const ghost_entry_t *g) {
+  return (size_t)g->npages << c->page_shift;
+}
 
-  if (ht_init(&c->resident, resident_cap) != 0) return -1;
-  if (ht_init(&c->ghosts, ghosts_cap) != 0) {
-    ht_destroy(&c->resident);
-    return -1;
-  }
-  return 0;
+/* Longest extent the cache accepts: an eighth of it, at most 64 pages. */
+static size_t max_extent_pages(const vtpc_cache_t *c) {
+  size_t n = (c->capacity >> c->page_shift) / 8;
+  if (n > VTPC_MAX_EXTENT_PAGES) n = VTPC_MAX_EXTENT_PAGES;
+  if (n < 1) n = 1;
+  return (size_t)1 << (log2_sz(n + 1) - 1);
 }
 
 static void cache_free_page(page_entry_t *p) {
@@ -335,276 +858,3680 @@ static void cache_free_ghost(ghost_entry_t *g) {
   free(g);
 }
 
-static int cache_flush_page(vtpc_handle_t *h, page_entry_t *p) {
-  if (!p || !p->dirty) return 0;
+/* Record the extent of an entry being evicted as history. The policy links
+ * the returned ghost into its own list; NULL (ENOMEM) just means no history. */
+static ghost_entry_t* cache_ghost_add(vtpc_cache_t *c, const page_entry_t *p, uint8_t q) {
+  ghost_entry_t *g = (ghost_entry_t*)calloc(1, sizeof(*g));
+  if (!g) { errno = ENOMEM; return NULL; }
+  g->page_no = p->page_no;
+  g->npages = p->npages;
+  g->q = q;
+  g->aux.ghost = 1;
+
+  for (uint32_t i = 0; i < g->npages; i++) {
+    if (ht_put(&c->ghosts, g->page_no + i, g) != 0) {
+      for (uint32_t j = 0; j < i; j++) ht_del(&c->ghosts, g->page_no + j);
+      cache_free_ghost(g);
+      return NULL;
+    }
+  }
+  return g;
+}
 
-  off_t off = (off_t)(p->page_no * (uint64_t)h->cache.page_size);
-  ssize_t w = pwrite_fullpage(h, p->data, h->cache.page_size, off);
-  if (w < 0) return -1;
+/* Free a ghost the policy has already unlinked. */
+static void cache_ghost_free(vtpc_cache_t *c, ghost_entry_t *g) {
+  for (uint32_t i = 0; i < g->npages; i++) ht_del(&c->ghosts, g->page_no + i);
+  cache_free_ghost(g);
+}
 
+static void cache_forget_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  c->pol->forget_ghost(c, g);
+  cache_ghost_free(c, g);
+}
 
-  if (ftruncate(h->os_fd, h->size) != 0) return -1;
 
-  p->dirty = 0;
-  return 0;
-}
+/* ---- 2Q: A1in FIFO, Am LRU, A1out ghost FIFO ----
+ *
+ * Unless kin_pct/kout_pct fix them, Kin and Kout follow the workload. Once
+ * per epoch of misses, ghost hits within the youngest step of A1out (A1in
+ * one step larger would have kept them) are weighed against hits on a
+ * step-sized history of Am evictions (the same for Am), and Kin moves one
+ * step toward the side that would have gained more; that side must win by
+ * half. Kout follows what the older half of A1out is worth: entries it
+ * promotes to Am are marked, and Kout grows while two in three of them earn
+ * an Am hit before eviction and shrinks while three in five do not. Kin stays
+ * within 5..75% of capacity, Kout within 25..300%. */
 
-static int cache_add_ghost(vtpc_cache_t *c, uint64_t page_no) {
-  ghost_entry_t *existing = (ghost_entry_t*)ht_get(&c->ghosts, page_no);
-  if (existing) {
+enum { Q2_A1IN = 1, Q2_AM = 2, Q2_A1OUT = 3, Q2_AMOUT = 4, Q2_A1OUT_OLD = 5 };
 
-    ghost_list_remove(&c->a1out_head, &c->a1out_tail, existing);
-    ghost_list_push_front(&c->a1out_head, &c->a1out_tail, existing);
-    return 0;
-  }
+typedef struct {
+  size_t kin;
+  size_t kout;
 
-  ghost_entry_t *g = (ghost_entry_t*)calloc(1, sizeof(*g));
-  if (!g) { errno = ENOMEM; return -1; }
-  g->page_no = page_no;
+  size_t a1in_bytes;
+  size_t am_bytes;
+  size_t a1out_bytes;
+  size_t amout_bytes;
 
-  ghost_list_push_front(&c->a1out_head, &c->a1out_tail, g);
-  c->a1out_sz++;
-  ht_put(&c->ghosts, page_no, g);
+  page_entry_t *a1in_head, *a1in_tail; 
+  page_entry_t *am_head, *am_tail;     
+  ghost_entry_t *a1out_head, *a1out_tail; 
+  ghost_entry_t *amout_head, *amout_tail;   /* only when tuning */
+
+  int tune;
+  size_t step;
+  uint64_t a1out_pushed;    /* bytes ever added to A1out, ages its ghosts */
+  uint64_t epoch_misses;
+  uint64_t a1out_young_hits;
+  uint64_t amout_hits;
+  uint64_t old_useful;      /* promoted from old A1out, then hit in Am */
+  uint64_t old_wasted;      /* ... evicted from Am without a hit */
+} q2_state_t;
+
+static void q2_set_limits(const vtpc_cache_t *c, q2_state_t *s, const vtpc_opts *o) {
+  unsigned kin_pct = o->kin_pct ? o->kin_pct : 25;
+  unsigned kout_pct = o->kout_pct ? o->kout_pct : 50;
+
+  s->kin = max_sz(c->capacity / 100 * kin_pct, c->page_size);
+  if (s->kin >= c->capacity) s->kin = c->capacity / 2;
+  s->kout = max_sz(c->capacity / 100 * kout_pct, c->page_size);
+  s->tune = (o->kin_pct == 0 && o->kout_pct == 0);
+  s->step = max_sz((c->capacity / 16) & ~c->page_mask, c->page_size);
+}
 
-  /* trim A1out */
-  while (c->a1out_sz > c->kout) {
-    ghost_entry_t *old = ghost_list_pop_back(&c->a1out_head, &c->a1out_tail);
-    if (!old) break;
-    ht_del(&c->ghosts, old->page_no);
-    c->a1out_sz--;
-    cache_free_ghost(old);
-  }
+static int q2_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  q2_state_t *s = (q2_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+
+  q2_set_limits(c, s, o);
+  c->pol_state = s;
   return 0;
 }
 
-static int evict_from_a1in(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
-  page_entry_t *victim = page_list_pop_back(&c->a1in_head, &c->a1in_tail);
-  if (!victim) return 0;
+static void q2_free_ghosts(ghost_entry_t *g) {
+  while (g) {
+    ghost_entry_t *n = g->next;
+    cache_free_ghost(g);
+    g = n;
+  }
+}
 
-  c->a1in_sz--;
-  ht_del(&c->resident, victim->page_no);
+static void q2_destroy(vtpc_cache_t *c) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  q2_free_ghosts(s->a1out_head);
+  q2_free_ghosts(s->amout_head);
+  free(s);
+}
 
-  if (cache_flush_page(h, victim) != 0) {
+static void q2_retune(vtpc_cache_t *c, q2_state_t *s) {
+  size_t step = s->step;
+  size_t kin_min = max_sz(c->capacity / 20, c->page_size);
+  size_t kin_max = c->capacity / 4 * 3;
+  uint64_t a = s->a1out_young_hits;
+  uint64_t m = s->amout_hits;
 
-    page_list_push_front(&c->a1in_head, &c->a1in_tail, victim);
-    c->a1in_sz++;
-    ht_put(&c->resident, victim->page_no, victim);
-    return -1;
+  if (a + m >= 8) {
+    if (a * 2 > m * 3) s->kin = min_sz(s->kin + step, kin_max);
+    else if (m * 2 > a * 3) s->kin = (s->kin > kin_min + step) ? s->kin - step : kin_min;
+  }
+  uint64_t u = s->old_useful;
+  uint64_t w = s->old_wasted;
+  if (u + w >= 8) {
+    size_t kout_min = c->capacity / 4;
+    if (u > w * 2) s->kout = min_sz(s->kout + step, c->capacity * 3);
+    else if (w * 2 > u * 3) s->kout = (s->kout > kout_min + step) ? s->kout - step : kout_min;
   }
 
+  s->epoch_misses = 0;
+  s->a1out_young_hits = s->amout_hits = 0;
+  s->old_useful = s->old_wasted = 0;
+}
 
-  if (cache_add_ghost(c, victim->page_no) != 0) {
+static void q2_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
 
+  if (p->q == Q2_A1IN) {
+    page_list_remove(&s->a1in_head, &s->a1in_tail, p);
+    s->a1in_bytes -= bytes;
+    p->q = Q2_AM;
+    page_list_push_front(&s->am_head, &s->am_tail, p);
+    s->am_bytes += bytes;
+  } else {
+    if (p->ref) {
+      p->ref = 0;
+      s->old_useful++;
+    }
+    page_list_remove(&s->am_head, &s->am_tail, p);
+    page_list_push_front(&s->am_head, &s->am_tail, p);
   }
+}
 
-  cache_free_page(victim);
-  return 0;
+static int q2_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  if (g->q == Q2_AMOUT) {
+    s->amout_hits++;
+  } else {
+    uint64_t age = s->a1out_pushed - g->stamp;
+    if (age < s->step) s->a1out_young_hits++;
+    if (s->tune && age > s->kout / 2) return Q2_A1OUT_OLD;
+  }
+  return g->q;
 }
 
-static int evict_from_am(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
-  page_entry_t *victim = page_list_pop_back(&c->am_head, &c->am_tail);
-  if (!victim) return 0;
+/* Reclaim from A1in while it is over Kin, otherwise from the Am tail. */
+static page_entry_t* q2_choose_victim(vtpc_cache_t *c, int hint) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  (void)hint;
+  if (s->a1in_tail && (s->a1in_bytes >= s->kin || !s->am_tail)) return s->a1in_tail;
+  return s->am_tail;
+}
 
-  c->am_sz--;
-  ht_del(&c->resident, victim->page_no);
+static void q2_unlink(vtpc_cache_t *c, page_entry_t *p) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
 
-  if (cache_flush_page(h, victim) != 0) {
+  if (p->q == Q2_AM) {
+    page_list_remove(&s->am_head, &s->am_tail, p);
+    s->am_bytes -= bytes;
+  } else {
+    page_list_remove(&s->a1in_head, &s->a1in_tail, p);
+    s->a1in_bytes -= bytes;
+  }
+}
 
-    page_list_push_front(&c->am_head, &c->am_tail, victim);
-    c->am_sz++;
-    ht_put(&c->resident, victim->page_no, victim);
-    return -1;
+static void q2_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
+
+  q2_unlink(c, p);
+  if (p->q == Q2_AM) {
+    if (!s->tune) return;
+    if (p->ref) s->old_wasted++;
+    ghost_entry_t *g = cache_ghost_add(c, p, Q2_AMOUT);
+    if (g) {
+      ghost_list_push_front(&s->amout_head, &s->amout_tail, g);
+      s->amout_bytes += bytes;
+    }
+    while (s->amout_bytes > s->step && s->amout_tail) {
+      ghost_entry_t *old = ghost_list_pop_back(&s->amout_head, &s->amout_tail);
+      s->amout_bytes -= ghost_bytes(c, old);
+      cache_ghost_free(c, old);
+    }
+    return;
   }
 
-  cache_free_page(victim);
-  return 0;
-}
+  ghost_entry_t *g = cache_ghost_add(c, p, Q2_A1OUT);
+  if (g) {
+    s->a1out_pushed += bytes;
+    g->stamp = s->a1out_pushed;
+    ghost_list_push_front(&s->a1out_head, &s->a1out_tail, g);
+    s->a1out_bytes += bytes;
+  }
 
-static int ensure_space_for_a1in(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
+  /* trim A1out */
+  while (s->a1out_bytes > s->kout && s->a1out_tail) {
+    ghost_entry_t *old = ghost_list_pop_back(&s->a1out_head, &s->a1out_tail);
+    s->a1out_bytes -= ghost_bytes(c, old);
+    cache_ghost_free(c, old);
+  }
+}
 
+/* Queue p as a miss with hint would, leaving the tuner's counts alone. */
+static void q2_link(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
 
-  if (c->a1in_sz >= c->kin) {
-    return evict_from_a1in(h);
+  p->ref = (hint == Q2_A1OUT_OLD);
+  if (hint == Q2_A1OUT || hint == Q2_A1OUT_OLD) {
+    p->q = Q2_AM;
+    page_list_push_front(&s->am_head, &s->am_tail, p);
+    s->am_bytes += bytes;
+  } else {
+    p->q = Q2_A1IN;
+    page_list_push_front(&s->a1in_head, &s->a1in_tail, p);
+    s->a1in_bytes += bytes;
   }
+}
 
-  while ((c->a1in_sz + c->am_sz) >= c->capacity) {
+static void q2_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  q2_link(c, p, hint);
+  if (s->tune && ++s->epoch_misses >= max_sz(c->capacity >> c->page_shift, 64)) {
+    q2_retune(c, s);
+  }
+}
 
-    if (c->am_sz > 0) {
-      if (evict_from_am(h) != 0) return -1;
-    } else {
-      if (evict_from_a1in(h) != 0) return -1;
-    }
+static void q2_forget_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  q2_state_t *s = (q2_state_t*)c->pol_state;
+  if (g->q == Q2_AMOUT) {
+    ghost_list_remove(&s->amout_head, &s->amout_tail, g);
+    s->amout_bytes -= ghost_bytes(c, g);
+  } else {
+    ghost_list_remove(&s->a1out_head, &s->a1out_tail, g);
+    s->a1out_bytes -= ghost_bytes(c, g);
   }
-  return 0;
 }
 
-static int ensure_space_for_am(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
+static void q2_stats(const vtpc_cache_t *c, vtpc_stats *st) {
+  const q2_state_t *s = (const q2_state_t*)c->pol_state;
+  st->kin = s->kin;
+  st->kout = s->kout;
+}
 
+static const vtpc_policy_ops q2_ops = {
+  .name = "2q",
+  .init = q2_init,
+  .destroy = q2_destroy,
+  .on_hit = q2_on_hit,
+  .on_ghost_hit = q2_on_ghost_hit,
+  .choose_victim = q2_choose_victim,
+  .on_evict = q2_on_evict,
+  .remove = q2_unlink,
+  .on_miss = q2_on_miss,
+  .forget_ghost = q2_forget_ghost,
+  .stats = q2_stats,
+};
 
-  while (c->am_sz >= c->am_cap) {
-    if (evict_from_am(h) != 0) return -1;
-  }
 
+/* ---- ARC: T1/T2 resident LRUs, B1/B2 ghost LRUs, adaptive target p ---- */
 
-  while ((c->a1in_sz + c->am_sz) >= c->capacity) {
+enum { ARC_T1 = 1, ARC_T2 = 2, ARC_B1 = 3, ARC_B2 = 4 };
 
-    if (c->a1in_sz > 0) {
-      if (evict_from_a1in(h) != 0) return -1;
-    } else {
-      if (evict_from_am(h) != 0) return -1;
-    }
-  }
+typedef struct {
+  size_t p;               /* target size of T1 */
+
+  size_t t1_bytes, t2_bytes;
+  size_t b1_bytes, b2_bytes;
+
+  page_entry_t *t1_head, *t1_tail;
+  page_entry_t *t2_head, *t2_tail;
+  ghost_entry_t *b1_head, *b1_tail;
+  ghost_entry_t *b2_head, *b2_tail;
+} arc_state_t;
+
+static int arc_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  (void)o;
+  arc_state_t *s = (arc_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+  c->pol_state = s;
   return 0;
 }
 
-static page_entry_t* load_page(vtpc_handle_t *h, uint64_t page_no) {
-  vtpc_cache_t *c = &h->cache;
+static void arc_destroy(vtpc_cache_t *c) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  ghost_entry_t *lists[2] = {s->b1_head, s->b2_head};
+  for (int i = 0; i < 2; i++) {
+    ghost_entry_t *g = lists[i];
+    while (g) {
+      ghost_entry_t *n = g->next;
+      cache_free_ghost(g);
+      g = n;
+    }
+  }
+  free(s);
+}
 
-  page_entry_t *p = (page_entry_t*)calloc(1, sizeof(*p));
-  if (!p) { errno = ENOMEM; return NULL; }
+static void arc_unlink(vtpc_cache_t *c, page_entry_t *p) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  if (p->q == ARC_T1) {
+    page_list_remove(&s->t1_head, &s->t1_tail, p);
+    s->t1_bytes -= entry_bytes(c, p);
+  } else {
+    page_list_remove(&s->t2_head, &s->t2_tail, p);
+    s->t2_bytes -= entry_bytes(c, p);
+  }
+}
 
-  p->page_no = page_no;
-  p->dirty = 0;
-  p->valid_len = 0;
-  p->prev = p->next = NULL;
+static void arc_push_t2(vtpc_cache_t *c, page_entry_t *p) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  p->q = ARC_T2;
+  page_list_push_front(&s->t2_head, &s->t2_tail, p);
+  s->t2_bytes += entry_bytes(c, p);
+}
 
-  void *buf = NULL;
-  int rc = posix_memalign(&buf, c->page_size, c->page_size);
-  if (rc != 0) {
-    free(p);
-    errno = ENOMEM;
-    return NULL;
+static void arc_unlink_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  if (g->q == ARC_B1) {
+    ghost_list_remove(&s->b1_head, &s->b1_tail, g);
+    s->b1_bytes -= ghost_bytes(c, g);
+  } else {
+    ghost_list_remove(&s->b2_head, &s->b2_tail, g);
+    s->b2_bytes -= ghost_bytes(c, g);
   }
-  p->data = buf;
+}
 
-  off_t off = (off_t)(page_no * (uint64_t)c->page_size);
-  ssize_t r = pread_fullpage(h, p->data, c->page_size, off);
-  if (r < 0) {
-    cache_free_page(p);
-    return NULL;
+/* |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c */
+static void arc_trim_ghosts(vtpc_cache_t *c) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  while (s->b1_tail && s->t1_bytes + s->b1_bytes > c->capacity) {
+    ghost_entry_t *g = s->b1_tail;
+    arc_unlink_ghost(c, g);
+    cache_ghost_free(c, g);
   }
-  p->valid_len = (size_t)r;
-  if (p->valid_len < c->page_size) {
-    memset((uint8_t*)p->data + p->valid_len, 0, c->page_size - p->valid_len);
+  while (s->b2_tail &&
+         s->t1_bytes + s->t2_bytes + s->b1_bytes + s->b2_bytes > 2 * c->capacity) {
+    ghost_entry_t *g = s->b2_tail;
+    arc_unlink_ghost(c, g);
+    cache_ghost_free(c, g);
   }
-  return p;
 }
 
-static page_entry_t* cache_get(vtpc_handle_t *h, uint64_t page_no) {
-  vtpc_cache_t *c = &h->cache;
+static void arc_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  arc_unlink(c, p);
+  arc_push_t2(c, p);
+}
 
-  page_entry_t *p = (page_entry_t*)ht_get(&c->resident, page_no);
-  if (p) {
+static int arc_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  size_t bytes = ghost_bytes(c, g);
 
-    if (p->q == Q_A1IN) {
+  if (g->q == ARC_B1) {
+    size_t ratio = (s->b1_bytes && s->b2_bytes > s->b1_bytes) ? s->b2_bytes / s->b1_bytes : 1;
+    s->p = min_sz(c->capacity, s->p + ratio * bytes);
+  } else {
+    size_t ratio = (s->b2_bytes && s->b1_bytes > s->b2_bytes) ? s->b1_bytes / s->b2_bytes : 1;
+    size_t delta = ratio * bytes;
+    s->p = (s->p > delta) ? s->p - delta : 0;
+  }
+  return g->q;
+}
 
-      page_list_remove(&c->a1in_head, &c->a1in_tail, p);
-      c->a1in_sz--;
+/* REPLACE(x, p) from the ARC paper. */
+static page_entry_t* arc_choose_victim(vtpc_cache_t *c, int hint) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  if (s->t1_tail &&
+      (s->t1_bytes > s->p || (hint == ARC_B2 && s->t1_bytes >= s->p) || !s->t2_tail)) {
+    return s->t1_tail;
+  }
+  return s->t2_tail;
+}
 
-      if (ensure_space_for_am(h) != 0) return NULL;
+static void arc_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  int from_t1 = (p->q == ARC_T1);
+  arc_unlink(c, p);
+
+  ghost_entry_t *g = cache_ghost_add(c, p, from_t1 ? ARC_B1 : ARC_B2);
+  if (g && from_t1) {
+    ghost_list_push_front(&s->b1_head, &s->b1_tail, g);
+    s->b1_bytes += ghost_bytes(c, g);
+  } else if (g) {
+    ghost_list_push_front(&s->b2_head, &s->b2_tail, g);
+    s->b2_bytes += ghost_bytes(c, g);
+  }
+  arc_trim_ghosts(c);
+}
 
-      p->q = Q_AM;
-      page_list_push_front(&c->am_head, &c->am_tail, p);
-      c->am_sz++;
-    } else {
-      page_list_remove(&c->am_head, &c->am_tail, p);
-      page_list_push_front(&c->am_head, &c->am_tail, p);
-    }
-    return p;
+static void arc_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  arc_state_t *s = (arc_state_t*)c->pol_state;
+  if (hint == ARC_B1 || hint == ARC_B2) {
+    arc_push_t2(c, p);
+  } else {
+    p->q = ARC_T1;
+    page_list_push_front(&s->t1_head, &s->t1_tail, p);
+    s->t1_bytes += entry_bytes(c, p);
   }
+  arc_trim_ghosts(c);
+}
 
-  ghost_entry_t *g = (ghost_entry_t*)ht_get(&c->ghosts, page_no);
-  if (g) {
-    ghost_list_remove(&c->a1out_head, &c->a1out_tail, g);
-    ht_del(&c->ghosts, page_no);
-    c->a1out_sz--;
-    cache_free_ghost(g);
+static void arc_stats(const vtpc_cache_t *c, vtpc_stats *st) {
+  const arc_state_t *s = (const arc_state_t*)c->pol_state;
+  st->arc_p = s->p;
+}
 
-    if (ensure_space_for_am(h) != 0) return NULL;
+static const vtpc_policy_ops arc_ops = {
+  .name = "arc",
+  .init = arc_init,
+  .destroy = arc_destroy,
+  .on_hit = arc_on_hit,
+  .on_ghost_hit = arc_on_ghost_hit,
+  .choose_victim = arc_choose_victim,
+  .on_evict = arc_on_evict,
+  .remove = arc_unlink,
+  .on_miss = arc_on_miss,
+  .forget_ghost = arc_unlink_ghost,
+  .stats = arc_stats,
+};
 
-    p = load_page(h, page_no);
-    if (!p) return NULL;
 
-    p->q = Q_AM;
-    page_list_push_front(&c->am_head, &c->am_tail, p);
-    c->am_sz++;
-    ht_put(&c->resident, page_no, p);
-    return p;
-  }
+/* ---- S3-FIFO: small FIFO S, main FIFO M, ghost FIFO G ----
+ * A hit only bumps a 2-bit counter; entries are relinked lazily while a
+ * victim is searched: S entries seen again move to M, M entries with a
+ * nonzero counter are reinserted with it decremented. */
 
-  if (ensure_space_for_a1in(h) != 0) return NULL;
+enum { S3_S = 1, S3_M = 2, S3_G = 3 };
 
-  p = load_page(h, page_no);
-  if (!p) return NULL;
+#define S3_MAX_REF 3
 
-  p->q = Q_A1IN;
-  page_list_push_front(&c->a1in_head, &c->a1in_tail, p);
-  c->a1in_sz++;
-  ht_put(&c->resident, page_no, p);
-  return p;
+typedef struct {
+  size_t s_cap;           /* 10% of the cache */
+  size_t g_cap;           /* as much history as M holds */
+
+  size_t s_bytes, m_bytes, g_bytes;
+
+  page_entry_t *s_head, *s_tail;
+  page_entry_t *m_head, *m_tail;
+  ghost_entry_t *g_head, *g_tail;
+} s3_state_t;
+
+static int s3_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  (void)o;
+  s3_state_t *s = (s3_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+  s->s_cap = max_sz(c->capacity / 10, c->page_size);
+  s->g_cap = c->capacity - s->s_cap;
+  c->pol_state = s;
+  return 0;
 }
 
-static int cache_flush_all(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
-
-  for (page_entry_t *p = c->a1in_head; p; p = p->next) {
-    if (cache_flush_page(h, p) != 0) return -1;
-  }
-  for (page_entry_t *p = c->am_head; p; p = p->next) {
-    if (cache_flush_page(h, p) != 0) return -1;
+static void s3_destroy(vtpc_cache_t *c) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  ghost_entry_t *g = s->g_head;
+  while (g) {
+    ghost_entry_t *n = g->next;
+    cache_free_ghost(g);
+    g = n;
   }
+  free(s);
+}
 
-  if (fsync(h->os_fd) != 0) return -1;
-  if (ftruncate(h->os_fd, h->size) != 0) return -1;
-  return 0;
+static void s3_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  (void)c;
+  if (p->ref < S3_MAX_REF) p->ref++;
 }
 
-static void cache_destroy(vtpc_handle_t *h) {
-  vtpc_cache_t *c = &h->cache;
+static int s3_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  return g->q;
+}
 
-  page_entry_t *p = c->a1in_head;
-  while (p) {
-    page_entry_t *n = p->next;
-    cache_free_page(p);
-    p = n;
-  }
-  p = c->am_head;
+static page_entry_t* s3_choose_victim(vtpc_cache_t *c, int hint) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  (void)hint;
+
+  for (;;) {
+    if (s->s_tail && (s->s_bytes >= s->s_cap || !s->m_tail)) {
+      page_entry_t *t = s->s_tail;
+      if (t->ref == 0) return t;
+
+      page_list_remove(&s->s_head, &s->s_tail, t);
+      s->s_bytes -= entry_bytes(c, t);
+      t->q = S3_M;
+      t->ref = 0;
+      page_list_push_front(&s->m_head, &s->m_tail, t);
+      s->m_bytes += entry_bytes(c, t);
+      continue;
+    }
+
+    page_entry_t *t = s->m_tail;
+    if (!t) return NULL;
+    if (t->ref == 0) return t;
+
+    t->ref--;
+    page_list_remove(&s->m_head, &s->m_tail, t);
+    page_list_push_front(&s->m_head, &s->m_tail, t);
+  }
+}
+
+static void s3_forget_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  ghost_list_remove(&s->g_head, &s->g_tail, g);
+  s->g_bytes -= ghost_bytes(c, g);
+}
+
+static void s3_remove(vtpc_cache_t *c, page_entry_t *p) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  if (p->q == S3_M) {
+    page_list_remove(&s->m_head, &s->m_tail, p);
+    s->m_bytes -= entry_bytes(c, p);
+  } else {
+    page_list_remove(&s->s_head, &s->s_tail, p);
+    s->s_bytes -= entry_bytes(c, p);
+  }
+}
+
+static void s3_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
+
+  s3_remove(c, p);
+  if (p->q == S3_M) return;
+
+  ghost_entry_t *g = cache_ghost_add(c, p, S3_G);
+  if (g) {
+    ghost_list_push_front(&s->g_head, &s->g_tail, g);
+    s->g_bytes += bytes;
+  }
+  while (s->g_bytes > s->g_cap && s->g_tail) {
+    ghost_entry_t *old = s->g_tail;
+    s3_forget_ghost(c, old);
+    cache_ghost_free(c, old);
+  }
+}
+
+static void s3_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  s3_state_t *s = (s3_state_t*)c->pol_state;
+  p->ref = 0;
+  if (hint == S3_G) {
+    p->q = S3_M;
+    page_list_push_front(&s->m_head, &s->m_tail, p);
+    s->m_bytes += entry_bytes(c, p);
+  } else {
+    p->q = S3_S;
+    page_list_push_front(&s->s_head, &s->s_tail, p);
+    s->s_bytes += entry_bytes(c, p);
+  }
+}
+
+static const vtpc_policy_ops s3_ops = {
+  .name = "s3fifo",
+  .init = s3_init,
+  .destroy = s3_destroy,
+  .on_hit = s3_on_hit,
+  .on_ghost_hit = s3_on_ghost_hit,
+  .choose_victim = s3_choose_victim,
+  .on_evict = s3_on_evict,
+  .remove = s3_remove,
+  .on_miss = s3_on_miss,
+  .forget_ghost = s3_forget_ghost,
+};
+
+
+/* ---- LIRS: recency stack S of LIR, HIR and non-resident HIR entries,
+ * queue Q of resident HIR entries ----
+ * Entries re-referenced while still on S (a short inter-reference
+ * recency) become LIR and stay resident; the rest pass through the small
+ * HIR share and are evicted first, so loops and scans larger than the
+ * cache cannot flush the LIR set. */
+
+enum { LIRS_LIR = 1, LIRS_HIR = 2, LIRS_NR = 3 };
+
+typedef struct {
+  size_t lir_cap;         /* 99% of the cache */
+  size_t nr_cap;          /* non-resident history kept on S */
+
+  size_t lir_bytes, hir_bytes, nr_bytes;
+
+  vtpc_link_t *s_top, *s_bottom;
+  page_entry_t *q_head, *q_tail;    /* tail is evicted first */
+  ghost_entry_t *nr_head, *nr_tail; /* non-resident entries, oldest at tail */
+} lirs_state_t;
+
+static void lirs_stack_remove(lirs_state_t *s, vtpc_link_t *l) {
+  if (!l->linked) return;
+  if (l->prev) l->prev->next = l->next;
+  if (l->next) l->next->prev = l->prev;
+  if (s->s_top == l) s->s_top = l->next;
+  if (s->s_bottom == l) s->s_bottom = l->prev;
+  l->prev = l->next = NULL;
+  l->linked = 0;
+}
+
+static void lirs_stack_push(lirs_state_t *s, vtpc_link_t *l) {
+  lirs_stack_remove(s, l);
+  l->prev = NULL;
+  l->next = s->s_top;
+  if (s->s_top) s->s_top->prev = l;
+  s->s_top = l;
+  if (!s->s_bottom) s->s_bottom = l;
+  l->linked = 1;
+}
+
+/* Put `l` where `old` is on the stack and unlink `old`. */
+static void lirs_stack_replace(lirs_state_t *s, vtpc_link_t *old, vtpc_link_t *l) {
+  l->prev = old->prev;
+  l->next = old->next;
+  if (l->prev) l->prev->next = l;
+  if (l->next) l->next->prev = l;
+  if (s->s_top == old) s->s_top = l;
+  if (s->s_bottom == old) s->s_bottom = l;
+  l->linked = 1;
+  old->prev = old->next = NULL;
+  old->linked = 0;
+}
+
+static void lirs_drop_nr(vtpc_cache_t *c, ghost_entry_t *g) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  lirs_stack_remove(s, &g->aux);
+  ghost_list_remove(&s->nr_head, &s->nr_tail, g);
+  s->nr_bytes -= ghost_bytes(c, g);
+}
+
+/* Keep an LIR entry at the bottom of S. */
+static void lirs_prune(vtpc_cache_t *c) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  while (s->s_bottom) {
+    vtpc_link_t *l = s->s_bottom;
+    if (l->ghost) {
+      ghost_entry_t *g = container_of(l, ghost_entry_t, aux);
+      lirs_drop_nr(c, g);
+      cache_ghost_free(c, g);
+      continue;
+    }
+    if (container_of(l, page_entry_t, aux)->q == LIRS_LIR) break;
+    lirs_stack_remove(s, l);
+  }
+}
+
+static void lirs_push_q(vtpc_cache_t *c, page_entry_t *p) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  p->q = LIRS_HIR;
+  page_list_push_front(&s->q_head, &s->q_tail, p);
+  s->hir_bytes += entry_bytes(c, p);
+}
+
+static void lirs_remove_q(vtpc_cache_t *c, page_entry_t *p) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  page_list_remove(&s->q_head, &s->q_tail, p);
+  s->hir_bytes -= entry_bytes(c, p);
+}
+
+static void lirs_demote_bottom(vtpc_cache_t *c) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  lirs_prune(c);
+  if (!s->s_bottom) return;
+
+  page_entry_t *p = container_of(s->s_bottom, page_entry_t, aux);
+  lirs_stack_remove(s, &p->aux);
+  s->lir_bytes -= entry_bytes(c, p);
+  lirs_push_q(c, p);
+  lirs_prune(c);
+}
+
+/* Demote bottom LIR entries to HIR until the LIR set fits. */
+static void lirs_fit_lir(vtpc_cache_t *c) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  while (s->lir_bytes > s->lir_cap && s->s_bottom) lirs_demote_bottom(c);
+}
+
+static int lirs_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  (void)o;
+  lirs_state_t *s = (lirs_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+  s->lir_cap = c->capacity - max_sz(c->capacity / 100, c->page_size);
+  s->nr_cap = 2 * c->capacity;
+  c->pol_state = s;
+  return 0;
+}
+
+static void lirs_destroy(vtpc_cache_t *c) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  ghost_entry_t *g = s->nr_head;
+  while (g) {
+    ghost_entry_t *n = g->next;
+    cache_free_ghost(g);
+    g = n;
+  }
+  free(s);
+}
+
+static void lirs_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+
+  if (p->q == LIRS_LIR) {
+    int was_bottom = (s->s_bottom == &p->aux);
+    lirs_stack_push(s, &p->aux);
+    if (was_bottom) lirs_prune(c);
+    return;
+  }
+
+  lirs_remove_q(c, p);
+  if (p->aux.linked) {
+    lirs_stack_push(s, &p->aux);
+    p->q = LIRS_LIR;
+    s->lir_bytes += entry_bytes(c, p);
+    lirs_fit_lir(c);
+  } else {
+    lirs_stack_push(s, &p->aux);
+    lirs_push_q(c, p);
+  }
+}
+
+static int lirs_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  return g->q;
+}
+
+static page_entry_t* lirs_choose_victim(vtpc_cache_t *c, int hint) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  (void)hint;
+  if (!s->q_tail) lirs_demote_bottom(c);
+  return s->q_tail;
+}
+
+static void lirs_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+
+  if (p->q == LIRS_LIR) {
+    lirs_stack_remove(s, &p->aux);
+    s->lir_bytes -= entry_bytes(c, p);
+    lirs_prune(c);
+    return;
+  }
+
+  lirs_remove_q(c, p);
+  if (!p->aux.linked) return;
+
+  ghost_entry_t *g = cache_ghost_add(c, p, LIRS_NR);
+  if (!g) {
+    lirs_stack_remove(s, &p->aux);
+    return;
+  }
+  lirs_stack_replace(s, &p->aux, &g->aux);
+  ghost_list_push_front(&s->nr_head, &s->nr_tail, g);
+  s->nr_bytes += ghost_bytes(c, g);
+
+  while (s->nr_bytes > s->nr_cap && s->nr_tail) {
+    ghost_entry_t *old = s->nr_tail;
+    lirs_drop_nr(c, old);
+    cache_ghost_free(c, old);
+  }
+}
+
+/* Off S and Q alike: a pinned entry is read again with no recency. */
+static void lirs_remove(vtpc_cache_t *c, page_entry_t *p) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  if (p->q == LIRS_LIR) {
+    s->lir_bytes -= entry_bytes(c, p);
+  } else {
+    lirs_remove_q(c, p);
+  }
+  lirs_stack_remove(s, &p->aux);
+  lirs_prune(c);
+}
+
+static void lirs_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  lirs_state_t *s = (lirs_state_t*)c->pol_state;
+  size_t bytes = entry_bytes(c, p);
+
+  lirs_stack_push(s, &p->aux);
+  if (hint == LIRS_NR || s->lir_bytes + bytes <= s->lir_cap) {
+    p->q = LIRS_LIR;
+    s->lir_bytes += bytes;
+    lirs_fit_lir(c);
+  } else {
+    lirs_push_q(c, p);
+  }
+}
+
+static const vtpc_policy_ops lirs_ops = {
+  .name = "lirs",
+  .init = lirs_init,
+  .destroy = lirs_destroy,
+  .on_hit = lirs_on_hit,
+  .on_ghost_hit = lirs_on_ghost_hit,
+  .choose_victim = lirs_choose_victim,
+  .on_evict = lirs_on_evict,
+  .remove = lirs_remove,
+  .on_miss = lirs_on_miss,
+  .forget_ghost = lirs_drop_nr,
+};
+
+
+/* ---- OPT: evict the furthest hinted next use (Belady with hints) ----
+ *
+ * vtpc_advice records when a block will next be read. Hinted entries sit
+ * on a heap keyed by ~when, so the furthest next use is on top; a hint is
+ * used up by the access it announced. Unhinted entries are handled by the
+ * 2Q hooks and are evicted first: nothing says they will be needed. Hints
+ * for blocks that are not in the policy wait in a bounded table, oldest
+ * dropped first, until the block is loaded. */
+
+enum { OPT_HINTED = 4 };
+
+typedef struct opt_hint {
+  uint64_t page_no;
+  uint64_t when;
+  struct opt_hint *prev;
+  struct opt_hint *next;
+} opt_hint_t;
+
+typedef struct {
+  q2_state_t q2;          /* first, so the 2Q hooks work on this state */
+  heap_t heap;
+  ht_t hints;             /* page -> opt_hint_t */
+  opt_hint_t *hint_head;  /* newest */
+  opt_hint_t *hint_tail;
+  size_t max_hints;
+} opt_state_t;
+
+static void opt_hint_unlink(opt_state_t *s, opt_hint_t *e) {
+  if (e->prev) e->prev->next = e->next;
+  else s->hint_head = e->next;
+  if (e->next) e->next->prev = e->prev;
+  else s->hint_tail = e->prev;
+  ht_del(&s->hints, e->page_no);
+}
+
+static void opt_hint_put(opt_state_t *s, uint64_t page_no, uint64_t when) {
+  opt_hint_t *e = (opt_hint_t*)ht_get(&s->hints, page_no);
+  if (e) {
+    if (when < e->when) e->when = when;
+    return;
+  }
+
+  if (s->hints.used >= s->max_hints) {
+    e = s->hint_tail;
+    opt_hint_unlink(s, e);
+  } else {
+    e = (opt_hint_t*)malloc(sizeof(*e));
+    if (!e) return;
+  }
+  e->page_no = page_no;
+  e->when = when;
+  if (ht_put(&s->hints, page_no, e) != 0) {
+    free(e);
+    return;
+  }
+  e->prev = NULL;
+  e->next = s->hint_head;
+  if (s->hint_head) s->hint_head->prev = e;
+  else s->hint_tail = e;
+  s->hint_head = e;
+}
+
+/* Earliest pending hint for the pages of p, consumed; ~0 if none. */
+static uint64_t opt_hint_take(opt_state_t *s, const page_entry_t *p) {
+  uint64_t when = ~(uint64_t)0;
+  if (!s->hint_head) return when;
+
+  for (uint32_t i = 0; i < p->npages; i++) {
+    opt_hint_t *e = (opt_hint_t*)ht_get(&s->hints, p->page_no + i);
+    if (!e) continue;
+    if (e->when < when) when = e->when;
+    opt_hint_unlink(s, e);
+    free(e);
+  }
+  return when;
+}
+
+static int opt_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  opt_state_t *s = (opt_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+
+  q2_set_limits(c, &s->q2, o);
+  s->max_hints = (c->capacity >> c->page_shift) * 4;
+  if (ht_init(&s->hints, next_pow2(s->max_hints * 2)) != 0) {
+    free(s);
+    return -1;
+  }
+  c->pol_state = s;
+  return 0;
+}
+
+static void opt_destroy(vtpc_cache_t *c) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  opt_hint_t *e = s->hint_head;
+  while (e) {
+    opt_hint_t *n = e->next;
+    free(e);
+    e = n;
+  }
+  ht_destroy(&s->hints);
+  heap_destroy(&s->heap);
+  q2_destroy(c);
+}
+
+static void opt_forget_slot(vtpc_cache_t *c, uint64_t key_base) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  for (opt_hint_t *e = s->hint_head; e;) {
+    opt_hint_t *n = e->next;
+    if ((e->page_no & ~VTPC_FILE_PAGE_MASK) == key_base) {
+      opt_hint_unlink(s, e);
+      free(e);
+    }
+    e = n;
+  }
+}
+
+static void opt_push_hinted(vtpc_cache_t *c, page_entry_t *p, uint64_t when) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  p->key = ~when;
+  p->q = OPT_HINTED;
+  if (heap_push(&s->heap, p) != 0) q2_link(c, p, 0);
+}
+
+static void opt_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  if (p->q != OPT_HINTED) {
+    q2_on_hit(c, p);
+    return;
+  }
+  /* the announced access happened; the entry is unhinted again, and goes
+   * to Am as a hit would, not counted as a miss */
+  heap_remove(&s->heap, p);
+  q2_link(c, p, Q2_A1OUT);
+}
+
+static page_entry_t* opt_choose_victim(vtpc_cache_t *c, int hint) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  page_entry_t *top = heap_top(&s->heap);
+  if (top && top->key == 0) return top;    /* hinted as never needed again */
+
+  page_entry_t *p = q2_choose_victim(c, hint);
+  return p ? p : top;
+}
+
+static void opt_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  if (p->q == OPT_HINTED) heap_remove(&s->heap, p);
+  else q2_on_evict(c, p);
+}
+
+static void opt_remove(vtpc_cache_t *c, page_entry_t *p) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  if (p->q == OPT_HINTED) heap_remove(&s->heap, p);
+  else q2_unlink(c, p);
+}
+
+static void opt_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  uint64_t when = opt_hint_take(s, p);
+  if (when != ~(uint64_t)0) opt_push_hinted(c, p, when);
+  else q2_on_miss(c, p, hint);
+}
+
+/* The earliest hint of an extent's pages wins until the extent is read. */
+static void opt_advise(vtpc_cache_t *c, uint64_t page_no, uint64_t npages, uint64_t when) {
+  opt_state_t *s = (opt_state_t*)c->pol_state;
+  uint64_t end = page_no + npages;
+
+  for (uint64_t q = page_no; q < end; q++) {
+    /* entries outside the policy take the hint when they enter it */
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, q);
+    if (!p || p->win || p->side) {
+      opt_hint_put(s, q, when);
+      continue;
+    }
+
+    if (p->q != OPT_HINTED) {
+      q2_unlink(c, p);
+      opt_push_hinted(c, p, when);
+    } else if (~when > p->key) {
+      p->key = ~when;
+      heap_update(&s->heap, p);
+    }
+    q = p->page_no + p->npages - 1;
+  }
+}
+
+static const vtpc_policy_ops opt_ops = {
+  .name = "opt",
+  .init = opt_init,
+  .destroy = opt_destroy,
+  .on_hit = opt_on_hit,
+  .on_ghost_hit = q2_on_ghost_hit,
+  .choose_victim = opt_choose_victim,
+  .on_evict = opt_on_evict,
+  .remove = opt_remove,
+  .on_miss = opt_on_miss,
+  .forget_ghost = q2_forget_ghost,
+  .forget_slot = opt_forget_slot,
+  .advise = opt_advise,
+  .stats = q2_stats,
+};
+
+
+/* ---- LRU-K: evict the largest backward K-distance ----
+ *
+ * Time is the API call counter, so every block touched by one vtpc_read or
+ * vtpc_write shares a timestamp. A reference within lru_k_crp calls of the
+ * previous one is correlated: it refreshes `last` but is not a new
+ * reference. Entries with fewer than K references have an infinite
+ * K-distance and go first, oldest first. History of evicted extents is kept,
+ * FIFO, for about as many extents as fit in the cache. It is keyed by the
+ * extent's first block, and extents need not come back with the same
+ * bounds: a miss takes over the history of the evicted extents it
+ * overlaps. */
+
+typedef struct lruk_hist {
+  uint64_t page_no;
+  uint32_t npages;
+  uint64_t last;                  /* most recent reference, correlated or not */
+  uint64_t t[VTPC_LRUK_MAX_K];    /* t[i]: (i+1)-th most recent reference */
+  int resident;                   /* on res_head, not old_head */
+  struct lruk_hist *prev;
+  struct lruk_hist *next;
+} lruk_hist_t;
+
+typedef struct {
+  unsigned k;
+  uint64_t crp;
+  heap_t heap;
+  ht_t hist;                      /* extent start -> lruk_hist_t */
+  lruk_hist_t *res_head;          /* histories of resident extents */
+  lruk_hist_t *old_head;          /* evicted, newest first */
+  lruk_hist_t *old_tail;
+  size_t nold;
+  size_t max_old;
+} lruk_state_t;
+
+static void lruk_list_remove(lruk_hist_t **head, lruk_hist_t **tail, lruk_hist_t *r) {
+  if (r->prev) r->prev->next = r->next;
+  else *head = r->next;
+  if (r->next) r->next->prev = r->prev;
+  else if (tail) *tail = r->prev;
+  r->prev = r->next = NULL;
+}
+
+static void lruk_list_push(lruk_hist_t **head, lruk_hist_t **tail, lruk_hist_t *r) {
+  r->prev = NULL;
+  r->next = *head;
+  if (*head) (*head)->prev = r;
+  else if (tail) *tail = r;
+  *head = r;
+}
+
+static void lruk_free_list(lruk_hist_t *r) {
+  while (r) {
+    lruk_hist_t *n = r->next;
+    free(r);
+    r = n;
+  }
+}
+
+static void lruk_reference(const lruk_state_t *s, lruk_hist_t *r, uint64_t now) {
+  if (r->last && now - r->last < s->crp) {
+    r->last = now;
+    return;
+  }
+
+  /* close the correlated period: shift older references by its length */
+  uint64_t period = r->last - r->t[0];
+  for (unsigned i = s->k - 1; i > 0; i--) {
+    r->t[i] = r->t[i - 1] ? r->t[i - 1] + period : 0;
+  }
+  r->t[0] = now;
+  r->last = now;
+}
+
+/* Min-heap key: fewer than K references sort before any full history. */
+static uint64_t lruk_key(const lruk_state_t *s, const lruk_hist_t *r) {
+  if (!r) return 0;
+  if (r->t[s->k - 1]) return ((uint64_t)1 << 63) | r->t[s->k - 1];
+  return r->t[0];
+}
+
+static int lruk_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  lruk_state_t *s = (lruk_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+
+  s->k = o->lru_k;
+  s->crp = o->lru_k_crp;
+  s->max_old = c->capacity >> c->page_shift;
+  if (ht_init(&s->hist, next_pow2(s->max_old * 4)) != 0) {
+    free(s);
+    return -1;
+  }
+  if (heap_reserve(&s->heap, s->max_old + 1) != 0) {
+    ht_destroy(&s->hist);
+    free(s);
+    return -1;
+  }
+  c->pol_state = s;
+  return 0;
+}
+
+static void lruk_destroy(vtpc_cache_t *c) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  lruk_free_list(s->res_head);
+  lruk_free_list(s->old_head);
+  ht_destroy(&s->hist);
+  heap_destroy(&s->heap);
+  free(s);
+}
+
+static void lruk_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  lruk_hist_t *r = (lruk_hist_t*)ht_get(&s->hist, p->page_no);
+  if (!r) return;
+
+  lruk_reference(s, r, c->op_seq);
+  p->key = lruk_key(s, r);
+  heap_update(&s->heap, p);
+}
+
+static int lruk_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  (void)g;
+  return 0;
+}
+
+static page_entry_t* lruk_choose_victim(vtpc_cache_t *c, int hint) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  (void)hint;
+  return heap_top(&s->heap);
+}
+
+static void lruk_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  heap_remove(&s->heap, p);
+
+  lruk_hist_t *r = (lruk_hist_t*)ht_get(&s->hist, p->page_no);
+  if (!r) return;
+  lruk_list_remove(&s->res_head, NULL, r);
+  lruk_list_push(&s->old_head, &s->old_tail, r);
+  r->resident = 0;
+  s->nold++;
+
+  while (s->nold > s->max_old) {
+    lruk_hist_t *old = s->old_tail;
+    lruk_list_remove(&s->old_head, &s->old_tail, old);
+    ht_del(&s->hist, old->page_no);
+    free(old);
+    s->nold--;
+  }
+}
+
+static void lruk_remove(vtpc_cache_t *c, page_entry_t *p) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  heap_remove(&s->heap, p);
+}
+
+/* Unlink the histories of evicted extents overlapping p and return the one
+ * with the most to say, freeing the rest. */
+static lruk_hist_t* lruk_take_old(lruk_state_t *s, const page_entry_t *p) {
+  uint64_t back = min_sz((size_t)(p->page_no & VTPC_FILE_PAGE_MASK), VTPC_MAX_EXTENT_PAGES - 1);
+  lruk_hist_t *best = NULL;
+
+  for (uint64_t q = p->page_no - back; q < p->page_no + p->npages; q++) {
+    lruk_hist_t *r = (lruk_hist_t*)ht_get(&s->hist, q);
+    if (!r || r->resident || q + r->npages <= p->page_no) continue;
+    lruk_list_remove(&s->old_head, &s->old_tail, r);
+    s->nold--;
+    ht_del(&s->hist, q);
+    if (best && lruk_key(s, best) >= lruk_key(s, r)) {
+      free(r);
+      continue;
+    }
+    free(best);
+    best = r;
+  }
+  return best;
+}
+
+static void lruk_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  (void)hint;
+
+  lruk_hist_t *r = (lruk_hist_t*)ht_get(&s->hist, p->page_no);
+  if (r && r->resident) {
+    /* back from a pin: its history never left */
+    lruk_reference(s, r, c->op_seq);
+    p->key = lruk_key(s, r);
+    (void)heap_push(&s->heap, p);
+    return;
+  }
+  r = lruk_take_old(s, p);
+  if (!r) r = (lruk_hist_t*)calloc(1, sizeof(*r));
+  if (r && ht_put(&s->hist, p->page_no, r) != 0) {
+    free(r);
+    r = NULL;
+  }
+
+  if (r) {
+    r->page_no = p->page_no;
+    r->npages = p->npages;
+    lruk_reference(s, r, c->op_seq);
+    lruk_list_push(&s->res_head, NULL, r);
+    r->resident = 1;
+  }
+  p->key = lruk_key(s, r);
+  (void)heap_push(&s->heap, p);  /* reserved in lruk_init */
+}
+
+static void lruk_forget_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  (void)g;
+}
+
+/* The slot's extents are gone by now, but a resident history stays on
+ * res_head when its entry leaves through cache_unlink. */
+static void lruk_forget_slot(vtpc_cache_t *c, uint64_t key_base) {
+  lruk_state_t *s = (lruk_state_t*)c->pol_state;
+  for (int old = 0; old < 2; old++) {
+    for (lruk_hist_t *r = old ? s->old_head : s->res_head; r;) {
+      lruk_hist_t *n = r->next;
+      if ((r->page_no & ~VTPC_FILE_PAGE_MASK) == key_base) {
+        if (old) {
+          lruk_list_remove(&s->old_head, &s->old_tail, r);
+          s->nold--;
+        } else {
+          lruk_list_remove(&s->res_head, NULL, r);
+        }
+        ht_del(&s->hist, r->page_no);
+        free(r);
+      }
+      r = n;
+    }
+  }
+}
+
+static const vtpc_policy_ops lruk_ops = {
+  .name = "lruk",
+  .init = lruk_init,
+  .destroy = lruk_destroy,
+  .on_hit = lruk_on_hit,
+  .on_ghost_hit = lruk_on_ghost_hit,
+  .choose_victim = lruk_choose_victim,
+  .on_evict = lruk_on_evict,
+  .remove = lruk_remove,
+  .on_miss = lruk_on_miss,
+  .forget_ghost = lruk_forget_ghost,
+  .forget_slot = lruk_forget_slot,
+};
+
+
+/* ---- GreedyDual: recency weighed against refetch cost ----
+ *
+ * Every entry is worth L + cost, where cost is its owner's measured read
+ * latency per block (or vtpc_opts.cost_ns), plus its write-back latency
+ * per block times the share of the entry that is dirty (all of it while
+ * being written). Per block is GreedyDual-Size's cost over size: an extent
+ * costs npages blocks to read again and holds as many, so it is worth no
+ * more for being large. The cheapest entry goes first and L rises to its
+ * worth, so entries that are not referenced again age out however costly
+ * they are. In a pool, blocks of a slow file outlast those of a fast one. */
+
+typedef struct {
+  heap_t heap;
+  uint64_t inflation;     /* L */
+} gd_state_t;
+
+static uint64_t gd_worth(const vtpc_cache_t *c, const gd_state_t *s, const page_entry_t *p) {
+  const vtpc_handle_t *h = p->owner;
+  uint64_t fill = h->opts.cost_ns ? h->opts.cost_ns : h->fill_ns;
+  uint64_t cost = fill ? fill : 1;
+  uint64_t flush = h->flush_ns ? h->flush_ns : fill;
+  if (c->op_write) cost += flush;
+  else if (p->dirty) cost += flush * (uint64_t)__builtin_popcountll(p->dirty) / p->npages;
+  return s->inflation + cost;
+}
+
+static int gd_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  (void)o;
+  gd_state_t *s = (gd_state_t*)calloc(1, sizeof(*s));
+  if (!s) { errno = ENOMEM; return -1; }
+  if (heap_reserve(&s->heap, (c->capacity >> c->page_shift) + 1) != 0) {
+    free(s);
+    return -1;
+  }
+  c->pol_state = s;
+  return 0;
+}
+
+static void gd_destroy(vtpc_cache_t *c) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  heap_destroy(&s->heap);
+  free(s);
+}
+
+static void gd_on_hit(vtpc_cache_t *c, page_entry_t *p) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  p->key = gd_worth(c, s, p);
+  heap_update(&s->heap, p);
+}
+
+static int gd_on_ghost_hit(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  (void)g;
+  return 0;
+}
+
+static page_entry_t* gd_choose_victim(vtpc_cache_t *c, int hint) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  (void)hint;
+  return heap_top(&s->heap);
+}
+
+static void gd_on_evict(vtpc_cache_t *c, page_entry_t *p) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  if (p->key > s->inflation) s->inflation = p->key;
+  heap_remove(&s->heap, p);
+}
+
+static void gd_remove(vtpc_cache_t *c, page_entry_t *p) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  heap_remove(&s->heap, p);
+}
+
+static void gd_on_miss(vtpc_cache_t *c, page_entry_t *p, int hint) {
+  gd_state_t *s = (gd_state_t*)c->pol_state;
+  (void)hint;
+  p->key = gd_worth(c, s, p);
+  (void)heap_push(&s->heap, p);  /* reserved in gd_init */
+}
+
+static void gd_forget_ghost(vtpc_cache_t *c, ghost_entry_t *g) {
+  (void)c;
+  (void)g;
+}
+
+static const vtpc_policy_ops gd_ops = {
+  .name = "gd",
+  .init = gd_init,
+  .destroy = gd_destroy,
+  .on_hit = gd_on_hit,
+  .on_ghost_hit = gd_on_ghost_hit,
+  .choose_victim = gd_choose_victim,
+  .on_evict = gd_on_evict,
+  .remove = gd_remove,
+  .on_miss = gd_on_miss,
+  .forget_ghost = gd_forget_ghost,
+};
+
+
+static const vtpc_policy_ops *const g_policies[] = {
+  [VTPC_POLICY_2Q] = &q2_ops,
+  [VTPC_POLICY_ARC] = &arc_ops,
+  [VTPC_POLICY_S3FIFO] = &s3_ops,
+  [VTPC_POLICY_LIRS] = &lirs_ops,
+  [VTPC_POLICY_OPT] = &opt_ops,
+  [VTPC_POLICY_LRUK] = &lruk_ops,
+  [VTPC_POLICY_GD] = &gd_ops,
+};
+
+#define VTPC_POLICY_COUNT (sizeof(g_policies) / sizeof(g_policies[0]))
+
+static vtpc_policy policy_by_name(const char *name) {
+  if (!name) return VTPC_POLICY_DEFAULT;
+  for (size_t i = 1; i < VTPC_POLICY_COUNT; i++) {
+    if (g_policies[i] && strcasecmp(name, g_policies[i]->name) == 0) return (vtpc_policy)i;
+  }
+  return VTPC_POLICY_DEFAULT;
+}
+
+
+/* Fill in process defaults and reject out-of-range values. The block size
+ * is checked against the file's direct-I/O alignment once it is open. */
+static int resolve_opts(const vtpc_opts *in, vtpc_opts *out) {
+  static const vtpc_opts none;
+  if (!in) in = &none;
+  *out = *in;
+
+  if (out->block_size != 0 &&
+      (!is_pow2(out->block_size) || out->block_size > VTPC_MAX_BLOCK_SIZE)) {
+    goto inval;
+  }
+  if (out->policy == VTPC_POLICY_DEFAULT) out->policy = g_cfg_policy;
+  if ((size_t)out->policy >= VTPC_POLICY_COUNT || !g_policies[out->policy]) goto inval;
+
+  if (out->kin_pct > 90 || out->kout_pct > 400) goto inval;
+
+  if (out->lru_k == 0) out->lru_k = 2;
+  if (out->lru_k_crp == 0) out->lru_k_crp = 1;
+  if (out->lru_k > VTPC_LRUK_MAX_K) goto inval;
+
+  if (out->extent_pages == 0) out->extent_pages = g_cfg_extent_pages;
+  if (out->extent_pages != 0 &&
+      (!is_pow2(out->extent_pages) || out->extent_pages > VTPC_MAX_EXTENT_PAGES)) {
+    goto inval;
+  }
+  if (out->ra_min_pages == 0) out->ra_min_pages = 1;
+  if (out->ra_max_pages == 0) out->ra_max_pages = VTPC_MAX_EXTENT_PAGES;
+  if (out->ra_max_pages > VTPC_MAX_EXTENT_PAGES ||
+      out->ra_min_pages > out->ra_max_pages) {
+    goto inval;
+  }
+
+  if (out->io > VTPC_IO_BUFFERED) goto inval;
+
+  if (out->admission == VTPC_ADMIT_DEFAULT) out->admission = g_cfg_admission;
+  if (out->admission > VTPC_ADMIT_TINYLFU) goto inval;
+
+  if (out->prefetch == VTPC_PREFETCH_DEFAULT) out->prefetch = g_cfg_prefetch;
+  if (out->prefetch > VTPC_PREFETCH_MARKOV) goto inval;
+  if (out->access > VTPC_ACCESS_WRITE_ONCE) goto inval;
+  if (out->pin_pct == 0) out->pin_pct = 25;
+  if (out->pin_pct > 90) goto inval;
+
+  if (out->pool < 0 || out->pool >= VTPC_MAX_POOLS) goto inval;
+  if (out->pool && !g_pools[out->pool]) goto inval;
+  return 0;
+
+inval:
+  errno = EINVAL;
+  return -1;
+}
+
+static int cache_init(vtpc_cache_t *c, const vtpc_opts *o) {
+  memset(c, 0, sizeof(*c));
+  size_t page_size = o->block_size;
+  c->page_size = page_size;
+  c->page_shift = log2_sz(page_size);
+  c->page_mask = page_size - 1;
+
+  size_t capacity = o->capacity ? o->capacity : g_cfg_cache_pages * page_size;
+  c->capacity = max_sz(capacity, 4 * page_size) & ~c->page_mask;
+  c->pin_cap = (c->capacity / 100 * o->pin_pct) & ~c->page_mask;
+
+  size_t resident_cap = next_pow2((c->capacity >> c->page_shift) * 4);
+  size_t ghosts_cap = next_pow2((c->capacity >> c->page_shift) * 2);
+
+  if (ht_init(&c->resident, resident_cap) != 0) return -1;
+  if (ht_init(&c->ghosts, ghosts_cap) != 0) {
+    ht_destroy(&c->resident);
+    return -1;
+  }
+
+  if (o->admission == VTPC_ADMIT_TINYLFU) {
+    if (sketch_init(&c->sketch, c->capacity >> c->page_shift) != 0) {
+      ht_destroy(&c->resident);
+      ht_destroy(&c->ghosts);
+      return -1;
+    }
+    c->tinylfu = 1;
+    c->win_cap = max_sz(c->capacity / 100, c->page_size) & ~c->page_mask;
+  }
+
+  c->pol = g_policies[o->policy];
+  if (c->pol->init(c, o) != 0) {
+    sketch_destroy(&c->sketch);
+    ht_destroy(&c->resident);
+    ht_destroy(&c->ghosts);
+    return -1;
+  }
+  return 0;
+}
+
+/* Write back the dirty runs of p through the handle that loaded it. */
+static int cache_flush_page(page_entry_t *p) {
+  if (!p || !p->dirty) return 0;
+
+  vtpc_handle_t *h = p->owner;
+  vtpc_cache_t *c = h->cache;
+  uint64_t t0 = now_ns();
+  uint32_t written = 0;
+  uint32_t i = 0;
+  while (i < p->npages) {
+    if (!(p->dirty & ((uint64_t)1 << i))) { i++; continue; }
+    uint32_t j = i;
+    while (j < p->npages && (p->dirty & ((uint64_t)1 << j))) j++;
+
+    off_t off = page_off(c, p->page_no + i);
+    size_t len = (size_t)(j - i) << c->page_shift;
+    ssize_t w = pwrite_fullpage(h, (uint8_t*)p->data + ((size_t)i << c->page_shift), len, off);
+    if (w < 0) return -1;
+    written += j - i;
+    i = j;
+  }
+
+
+  if (ftruncate(h->os_fd, h->size) != 0) return -1;
+
+  h->flush_ns = ewma_ns(h->flush_ns, (now_ns() - t0) / written);
+  p->dirty = 0;
+  c->writebacks++;
+  h->disk_gen++;
+  return 0;
+}
+
+static void resident_del(vtpc_cache_t *c, page_entry_t *p) {
+  for (uint32_t i = 0; i < p->npages; i++) ht_del(&c->resident, p->page_no + i);
+}
+
+static int resident_put(vtpc_cache_t *c, page_entry_t *p) {
+  for (uint32_t i = 0; i < p->npages; i++) {
+    if (ht_put(&c->resident, p->page_no + i, p) != 0) {
+      for (uint32_t j = 0; j < i; j++) ht_del(&c->resident, p->page_no + j);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void all_list_remove(vtpc_handle_t *h, page_entry_t *p) {
+  if (p->all_prev) p->all_prev->all_next = p->all_next;
+  if (p->all_next) p->all_next->all_prev = p->all_prev;
+  if (h->all_head == p) h->all_head = p->all_next;
+  p->all_prev = p->all_next = NULL;
+}
+
+static void all_list_push(vtpc_handle_t *h, page_entry_t *p) {
+  p->all_prev = NULL;
+  p->all_next = h->all_head;
+  if (h->all_head) h->all_head->all_prev = p;
+  h->all_head = p;
+}
+
+/* Take p off whichever queue holds it: the window, a side queue, the pinned
+ * set or the policy, which remembers it as a ghost if it is being evicted. */
+static void cache_dequeue(vtpc_cache_t *c, page_entry_t *p, int evict) {
+  if (p->win) {
+    page_list_remove(&c->win_head, &c->win_tail, p);
+    c->win_used -= entry_bytes(c, p);
+    p->win = 0;
+  } else if (p->side == SIDE_STREAM) {
+    page_list_remove(&c->stream_head, &c->stream_tail, p);
+  } else if (p->side == SIDE_LOOP) {
+    page_list_remove(&c->loop_head, &c->loop_tail, p);
+    c->loop_used -= entry_bytes(c, p);
+  } else if (p->side == SIDE_PIN) {
+    c->pinned -= entry_bytes(c, p);
+  } else if (evict) {
+    c->pol->on_evict(c, p);
+  } else {
+    c->pol->remove(c, p);
+  }
+  p->side = 0;
+}
+
+/* Hand a resident entry that left its queue back to admission, as if just
+ * loaded. */
+static void cache_readmit(vtpc_cache_t *c, page_entry_t *p) {
+  if (c->tinylfu) {
+    p->win = 1;
+    p->q = 0;
+    page_list_push_front(&c->win_head, &c->win_tail, p);
+    c->win_used += entry_bytes(c, p);
+  } else {
+    c->pol->on_miss(c, p, 0);
+  }
+}
+
+static void cache_unlink(vtpc_cache_t *c, page_entry_t *p) {
+  cache_dequeue(c, p, 1);
+  resident_del(c, p);
+  all_list_remove(p->owner, p);
+  c->used -= entry_bytes(c, p);
+}
+
+/* Weigh the Markov prefetches resolved so far; below 25% accuracy the
+ * prefetcher switches off for a while, still learning meanwhile. */
+static void markov_judge(vtpc_handle_t *h) {
+  uint64_t n = h->mk_win_hits + h->mk_win_wasted;
+  if (n < 64) return;
+  if (h->mk_win_hits * 4 < n) h->mk_backoff = 4096;
+  h->mk_win_hits = h->mk_win_wasted = 0;
+}
+
+static void map_sync(vtpc_handle_t *h, uint64_t lo, uint64_t hi, int drop);
+
+/* Write back and drop one entry, whichever handle of the cache owns it; on
+ * a write-back error it stays resident. */
+static int cache_evict(vtpc_handle_t *h, page_entry_t *p) {
+  vtpc_cache_t *c = h->cache;
+
+  if (p->owner->maps) {
+    uint64_t lo = (uint64_t)page_off(c, p->page_no);
+    map_sync(p->owner, lo, lo + entry_bytes(c, p), 1);
+  }
+  if (cache_flush_page(p) != 0) return -1;
+
+  cache_unlink(c, p);
+  c->evictions++;
+  if (p->pf == PF_STRIDE) {
+    /* loaded for nothing: look less far ahead */
+    vtpc_handle_t *o = p->owner;
+    o->pf_depth = max_sz(o->pf_depth / 2, 1);
+  } else if (p->pf == PF_MARKOV) {
+    p->owner->mk_win_wasted++;
+    markov_judge(p->owner);
+  }
+
+  cache_free_page(p);
+  return 0;
+}
+
+static void window_promote(vtpc_cache_t *c, page_entry_t *p) {
+  page_list_remove(&c->win_head, &c->win_tail, p);
+  c->win_used -= entry_bytes(c, p);
+  p->win = 0;
+  c->pol->on_miss(c, p, p->q);
+}
+
+static int cache_make_room(vtpc_handle_t *h, size_t need, int hint) {
+  vtpc_cache_t *c = h->cache;
+
+  for (;;) {
+    page_entry_t *cand = NULL;
+    if (c->tinylfu && c->win_tail && c->win_used + need > c->win_cap) cand = c->win_tail;
+
+    if (c->used + need <= c->capacity) {
+      if (!cand) break;
+      window_promote(c, cand);
+      continue;
+    }
+
+    page_entry_t *side = c->stream_tail;
+    if (!side && c->loop_used > c->capacity / 2) side = c->loop_head;
+    if (side) {
+      if (cache_evict(h, side) != 0) return -1;
+      continue;
+    }
+
+    page_entry_t *victim = c->pol->choose_victim(c, hint);
+    if (!victim && !cand && c->loop_head) victim = c->loop_head;
+    if (cand) {
+      /* the window candidate only displaces a victim it is hotter than */
+      if (victim && sketch_estimate(&c->sketch, cand->page_no) <=
+                        sketch_estimate(&c->sketch, victim->page_no)) {
+        c->admit_rejects++;
+        if (cache_evict(h, cand) != 0) return -1;
+        continue;
+      }
+      if (victim && cache_evict(h, victim) != 0) return -1;
+      window_promote(c, cand);
+      continue;
+    }
+    if (!victim) break;
+    if (cache_evict(h, victim) != 0) return -1;
+  }
+  return 0;
+}
+
+/* Pick the extent to load for a miss on page_no: an aligned window of the
+ * handle's fixed extent length, or a forward window that doubles while the
+ * misses stay sequential (jumps to its ceiling for sequential and looping
+ * handles, stays at its floor for strided and random ones). The window
+ * never overlaps resident pages and does not reach past EOF. */
+static uint32_t extent_for_miss(vtpc_handle_t *h, uint64_t page_no, uint64_t *start) {
+  vtpc_cache_t *c = h->cache;
+  size_t max_pages = max_extent_pages(c);
+  uint64_t s, e;
+
+  if (h->opts.extent_pages) {
+    size_t n = min_sz(h->opts.extent_pages, max_pages);
+    s = page_no & ~(uint64_t)(n - 1);
+    e = s + n;
+  } else {
+    size_t ceiling = min_sz(h->opts.ra_max_pages, max_pages);
+    if (h->cl == VTPC_ACCESS_STRIDED || h->cl == VTPC_ACCESS_RANDOM) {
+      h->ra_pages = min_sz(h->opts.ra_min_pages, max_pages);
+    } else if (page_no == h->ra_next && h->ra_pages) {
+      int stream = (h->cl == VTPC_ACCESS_SEQUENTIAL || h->cl == VTPC_ACCESS_LOOPING);
+      h->ra_pages = stream ? ceiling : min_sz(h->ra_pages * 2, ceiling);
+    } else {
+      h->ra_pages = min_sz(h->opts.ra_min_pages, max_pages);
+    }
+    s = page_no;
+    e = s + h->ra_pages;
+  }
+
+  uint64_t eof_pages = h->key_base + (((uint64_t)h->size + c->page_mask) >> c->page_shift);
+  if (eof_pages <= page_no) eof_pages = page_no + 1;
+  if (e > eof_pages) e = eof_pages;
+
+  for (uint64_t q = page_no; q > s; q--) {
+    if (ht_get(&c->resident, q - 1)) { s = q; break; }
+  }
+  for (uint64_t q = page_no + 1; q < e; q++) {
+    if (ht_get(&c->resident, q)) { e = q; break; }
+  }
+
+  *start = s;
+  return (uint32_t)(e - s);
+}
+
+/* vtpc_read_batch's misses, read ahead in runs: block miss[i] (untagged,
+ * sorted) is at at[i], with avail[i] bytes read from there on, or not read
+ * when at[i] is NULL. Those blocks were not resident when read, and a batch
+ * writes nothing, so their copies cannot go stale during the call. */
+typedef struct batch {
+  uint64_t *miss;
+  size_t nmiss;
+  uint8_t **at;
+  size_t *avail;
+  uint8_t **bufs;
+  size_t nbufs;
+} batch_t;
+
+/* The batch's copy of blocks [q, q + npages) (untagged), if it holds them
+ * all in one run. */
+static const uint8_t* batch_src(const batch_t *b, size_t page_size, uint64_t q, uint32_t npages,
+                                size_t *len) {
+  size_t lo = 0, hi = b->nmiss;
+  while (lo < hi) {
+    size_t m = lo + (hi - lo) / 2;
+    if (b->miss[m] < q) lo = m + 1; else hi = m;
+  }
+  if (lo + npages > b->nmiss || !b->at[lo]) return NULL;
+  for (uint32_t k = 0; k < npages; k++) {
+    if (b->miss[lo + k] != q + k || b->at[lo + k] != b->at[lo] + (size_t)k * page_size) {
+      return NULL;
+    }
+  }
+  *len = b->avail[lo];
+  return b->at[lo];
+}
+
+/* Read an extent from the file, or copy it from src (src_len valid bytes)
+ * when the caller already read a span around it. */
+static page_entry_t* load_page(vtpc_handle_t *h, uint64_t page_no, uint32_t npages,
+                               const uint8_t *src, size_t src_len) {
+  vtpc_cache_t *c = h->cache;
+  if (!src && h->batch) {
+    src = batch_src(h->batch, c->page_size, page_no & VTPC_FILE_PAGE_MASK, npages, &src_len);
+  }
+
+  page_entry_t *p = (page_entry_t*)calloc(1, sizeof(*p));
+  if (!p) { errno = ENOMEM; return NULL; }
+
+  p->page_no = page_no;
+  p->npages = npages;
+  p->owner = h;
+  p->dirty = 0;
+  p->valid_len = 0;
+  p->prev = p->next = NULL;
+
+  size_t len = entry_bytes(c, p);
+  void *buf = NULL;
+  int rc = posix_memalign(&buf, buffer_alignment(c->page_size), len);
+  if (rc != 0) {
+    free(p);
+    errno = ENOMEM;
+    return NULL;
+  }
+  p->data = buf;
+
+  if (src) {
+    p->valid_len = min_sz(len, src_len);
+    memcpy(p->data, src, p->valid_len);
+  } else {
+    off_t off = page_off(c, page_no);
+    uint64_t t0 = now_ns();
+    ssize_t r = pread_fullpage(h, p->data, len, off);
+    if (r < 0) {
+      cache_free_page(p);
+      return NULL;
+    }
+    h->fill_ns = ewma_ns(h->fill_ns, (now_ns() - t0) / npages);
+    p->valid_len = (size_t)r;
+  }
+  if (p->valid_len < len) {
+    memset((uint8_t*)p->data + p->valid_len, 0, len - p->valid_len);
+  }
+  return p;
+}
+
+/* Load [start, start + npages) and hand it to the side queue of the
+ * handle's class, the admission window or the policy. None of those pages
+ * may be resident. src as for load_page. */
+static page_entry_t* cache_insert(vtpc_handle_t *h, uint64_t start, uint32_t npages, int hint,
+                                  const uint8_t *src, size_t src_len) {
+  vtpc_cache_t *c = h->cache;
+  size_t need = (size_t)npages << c->page_shift;
+
+  if (cache_make_room(h, need, hint) != 0) return NULL;
+
+  page_entry_t *p = load_page(h, start, npages, src, src_len);
+  if (!p) return NULL;
+  if (resident_put(c, p) != 0) {
+    cache_free_page(p);
+    return NULL;
+  }
+
+  /* a page is never resident and a ghost at the same time */
+  for (uint32_t i = 0; i < npages; i++) {
+    ghost_entry_t *old = (ghost_entry_t*)ht_get(&c->ghosts, start + i);
+    if (old) cache_forget_ghost(c, old);
+  }
+
+  all_list_push(h, p);
+  c->used += need;
+  if (h->noreuse || h->cl == VTPC_ACCESS_SEQUENTIAL || h->cl == VTPC_ACCESS_WRITE_ONCE) {
+    p->side = SIDE_STREAM;
+    page_list_push_front(&c->stream_head, &c->stream_tail, p);
+    h->bypass_admits++;
+  } else if (h->cl == VTPC_ACCESS_LOOPING) {
+    p->side = SIDE_LOOP;
+    page_list_push_front(&c->loop_head, &c->loop_tail, p);
+    c->loop_used += need;
+    h->bypass_admits++;
+  } else if (c->tinylfu) {
+    /* the policy's admission hint waits in q until the entry leaves the window */
+    p->win = 1;
+    p->q = (uint8_t)hint;
+    page_list_push_front(&c->win_head, &c->win_tail, p);
+    c->win_used += need;
+  } else {
+    c->pol->on_miss(c, p, hint);
+  }
+  return p;
+}
+
+/* File data read ahead of the blocks it is cut into: len valid bytes from
+ * block lo on, read while h->disk_gen was gen. */
+typedef struct span {
+  const uint8_t *data;
+  uint64_t lo;
+  size_t len;
+  uint64_t gen;
+} span_t;
+
+/* Prefetch the blocks of [s, e) (untagged) that are not resident, skipping
+ * page `skip`, from the file or from a span already read. Returns -1 once a
+ * load fails; the caller's read goes on. */
+static int prefetch_range(vtpc_handle_t *h, uint8_t kind, uint64_t s, uint64_t e, uint64_t skip,
+                          const span_t *span) {
+  vtpc_cache_t *c = h->cache;
+  size_t max_pages = max_extent_pages(c);
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  if (e > eof_pages) e = eof_pages;
+
+  uint64_t q = s;
+  while (q < e) {
+    if (q == skip || ht_get(&c->resident, h->key_base | q)) { q++; continue; }
+    uint64_t r = q + 1;
+    while (r < e && r - q < max_pages && r != skip &&
+           !ht_get(&c->resident, h->key_base | r)) {
+      r++;
+    }
+    const uint8_t *src = NULL;
+    size_t src_len = 0;
+    if (span) {
+      /* a block dirty when the span was read may have been written back
+       * since (making room for the last run, say): the span can be stale */
+      if (h->disk_gen != span->gen) return 0;
+      size_t at = (size_t)(q - span->lo) << c->page_shift;
+      src = span->data + at;
+      src_len = (span->len > at) ? span->len - at : 0;
+    }
+    page_entry_t *p = cache_insert(h, h->key_base | q, (uint32_t)(r - q), 0, src, src_len);
+    if (!p) return -1;
+    p->pf = kind;
+    h->prefetches++;
+    if (kind == PF_MARKOV) h->mk_prefetches++;
+    q = r;
+  }
+  return 0;
+}
+
+/* Prefetch `depth` runs of len pages, d pages apart, past the run at f.
+ * When the runs are dense enough, one read of the span covering them is
+ * cheaper than a read per run; only the runs themselves are cached. */
+static int prefetch_strided(vtpc_handle_t *h, uint64_t f, int64_t d, uint64_t len, uint64_t depth) {
+  vtpc_cache_t *c = h->cache;
+  uint64_t dist = (uint64_t)(d < 0 ? -d : d);
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  uint64_t n = 0;
+  for (; n < depth; n++) {
+    int64_t s = (int64_t)f + d * (int64_t)(n + 1);
+    if (s < 0 || (uint64_t)s >= eof_pages) break;
+  }
+  if (n == 0) return 0;
+
+  uint64_t span_pages = min_sz(VTPC_MAX_EXTENT_PAGES, VTPC_PREFETCH_SPAN >> c->page_shift);
+  if (dist <= len * 8 && dist + len <= span_pages) {
+    if (!h->pf_span) {
+      void *buf = NULL;
+      if (posix_memalign(&buf, vtpc_page_size(), VTPC_PREFETCH_SPAN) != 0) return -1;
+      h->pf_span = (uint8_t*)buf;
+    }
+    n = min_sz(n, (span_pages - len) / dist + 1);
+    uint64_t lo = (d < 0) ? f - dist * n : f + dist;
+    uint64_t hi = min_sz(lo + dist * (n - 1) + len, eof_pages);
+    ssize_t r = pread_fullpage(h, h->pf_span, (size_t)(hi - lo) << c->page_shift, page_off(c, lo));
+    if (r < 0) return -1;
+    const span_t sp = {h->pf_span, lo, (size_t)r, h->disk_gen};
+    for (uint64_t i = 0; i < n; i++) {
+      uint64_t s = lo + dist * i;
+      if (prefetch_range(h, PF_STRIDE, s, s + len, f, &sp) != 0) return -1;
+    }
+    return 0;
+  }
+
+  for (uint64_t i = 1; i <= n; i++) {
+    uint64_t s = (uint64_t)((int64_t)f + d * (int64_t)i);
+    if (prefetch_range(h, PF_STRIDE, s, s + len, f, NULL) != 0) return -1;
+  }
+  return 0;
+}
+
+/* A new run at f, d pages past the previous run start (which had len
+ * pages), with run starts having kept that distance at least twice: load
+ * the runs ahead along it, a batch at a time once the next one is not
+ * resident. Forward runs that follow each other directly are left to the
+ * adaptive extents. */
+static void stride_prefetch(vtpc_handle_t *h, uint64_t f, int64_t d, uint64_t len) {
+  vtpc_cache_t *c = h->cache;
+
+  if (d > 0 && (uint64_t)d <= len) return;
+
+  /* top up in batches: nothing to do while the next run is still loaded */
+  int64_t next = (int64_t)f + ((d < 0 && (uint64_t)-d <= len) ? -1 : d);
+  if (next < 0 || ht_get(&c->resident, h->key_base | (uint64_t)next)) return;
+
+  /* ramp up with confidence, and never look further than a quarter of the cache */
+  uint64_t depth = min_sz(h->pf_depth, (size_t)1 << (h->pf_conf - 2));
+  uint64_t budget = max_sz((c->capacity >> c->page_shift) / 4, 1);
+  len = min_sz(len, max_extent_pages(c));
+  depth = max_sz(min_sz(depth, budget / len), 1);
+
+  if (d < 0 && (uint64_t)-d <= len) {
+    /* backward scan: one contiguous range below the current run */
+    uint64_t back = depth * (uint64_t)-d;
+    uint64_t s = (f > back) ? f - back : 0;
+    (void)prefetch_range(h, PF_STRIDE, s, f, f, NULL);
+  } else {
+    (void)prefetch_strided(h, f, d, len, depth);
+  }
+}
+
+static markov_slot_t* markov_slot(const vtpc_handle_t *h, uint64_t page) {
+  return &h->mk[hash_u64(page) & h->mk_mask];
+}
+
+/* Record that a run of len pages at `to` followed the run at `from`. */
+static void markov_train(vtpc_handle_t *h, uint64_t from, uint64_t to, uint64_t len) {
+  markov_slot_t *m = markov_slot(h, from);
+  if (m->page != from + 1) {
+    /* a slot with history resists the newcomer until it has decayed */
+    if (m->count[0] > 1 || m->count[1] > 1) {
+      if (m->count[0]) m->count[0]--;
+      if (m->count[1]) m->count[1]--;
+      return;
+    }
+    memset(m, 0, sizeof(*m));
+    m->page = from + 1;
+  }
+  len = min_sz(len, VTPC_MAX_EXTENT_PAGES);
+  for (int i = 0; i < 2; i++) {
+    if (m->next[i] == to + 1) {
+      if (m->count[i] < 15) m->count[i]++;
+      m->len[i] = (uint8_t)len;
+      return;
+    }
+  }
+  int w = (m->count[0] <= m->count[1]) ? 0 : 1;
+  if (m->count[w] > 0) {
+    m->count[w]--;
+    return;
+  }
+  m->next[w] = to + 1;
+  m->len[w] = (uint8_t)len;
+  m->count[w] = 1;
+}
+
+/* On a miss at f, load the successors seen at least twice, following the
+ * strongest one down the chain. */
+static void markov_prefetch(vtpc_handle_t *h, uint64_t f) {
+  uint64_t cur = f;
+  for (int depth = 0; depth < VTPC_MARKOV_DEPTH; depth++) {
+    const markov_slot_t *m = markov_slot(h, cur);
+    if (m->page != cur + 1) return;
+    int b = (m->count[0] >= m->count[1]) ? 0 : 1;
+    if (m->count[b] < 2) return;
+    if (depth == 0 && m->count[!b] >= 2) {
+      uint64_t s = m->next[!b] - 1;
+      if (prefetch_range(h, PF_MARKOV, s, s + m->len[!b], f, NULL) != 0) return;
+    }
+    uint64_t s = m->next[b] - 1;
+    if (prefetch_range(h, PF_MARKOV, s, s + m->len[b], f, NULL) != 0) return;
+    cur = s;
+  }
+}
+
+/* ---- Background fills: worker threads read, the handle installs ----
+ *
+ * Workers only pread into buffers of their own; the cache is touched by the
+ * caller's thread alone. A finished fill enters the cache when its handle
+ * next looks a block up, as a span cut into the blocks still not resident,
+ * unless one of the handle's blocks was written back since it was queued:
+ * the read may have seen the file before that write. */
+
+enum { FILL_QUEUED = 0, FILL_RUNNING, FILL_DONE };
+
+typedef struct fill_job {
+  vtpc_handle_t *h;
+  uint64_t page_no;        /* untagged */
+  uint32_t npages;
+  off_t off;
+  size_t len;
+  uint64_t gen;            /* h->disk_gen when queued */
+  uint8_t *data;
+  ssize_t got;
+  int err;                 /* errno of a failed read */
+  int state;               /* FILL_*, under g_fill.lock */
+  struct fill_job *next;   /* in h->fills */
+  struct fill_job *qnext;  /* in the worker queue */
+} fill_job_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  fill_job_t *head;
+  fill_job_t *tail;
+  int started;
+} g_fill = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+            NULL, NULL, 0};
+
+static void* fill_worker(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&g_fill.lock);
+  for (;;) {
+    while (!g_fill.head) pthread_cond_wait(&g_fill.work, &g_fill.lock);
+    fill_job_t *j = g_fill.head;
+    g_fill.head = j->qnext;
+    if (!g_fill.head) g_fill.tail = NULL;
+    j->state = FILL_RUNNING;
+    pthread_mutex_unlock(&g_fill.lock);
+
+    ssize_t r = pread_fullpage(j->h, j->data, j->len, j->off);
+    int e = errno;
+
+    pthread_mutex_lock(&g_fill.lock);
+    j->got = r;
+    if (r < 0) j->err = e;
+    j->state = FILL_DONE;
+    pthread_cond_broadcast(&g_fill.done);
+    if (j->h->efd >= 0) {
+      uint64_t one = 1;
+      (void)!write(j->h->efd, &one, sizeof(one));
+    }
+  }
+  return NULL;
+}
+
+/* Start the workers with every signal blocked: signals stay the caller's. */
+static int fill_start(void) {
+  if (g_fill.started) return 0;
+
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int n = 0;
+  for (; n < VTPC_FILL_WORKERS; n++) {
+    pthread_t t;
+    if (pthread_create(&t, NULL, fill_worker, NULL) != 0) break;
+    pthread_detach(t);
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  if (n == 0) { errno = EAGAIN; return -1; }
+  g_fill.started = 1;
+  return 0;
+}
+
+static void fill_free(fill_job_t *j) {
+  free(j->data);
+  free(j);
+}
+
+/* Hand a read of blocks [q, q + n) (untagged) for h to the workers. */
+static fill_job_t* fill_submit(vtpc_handle_t *h, uint64_t q, uint32_t n) {
+  vtpc_cache_t *c = h->cache;
+  if (fill_start() != 0) return NULL;
+
+  fill_job_t *j = (fill_job_t*)calloc(1, sizeof(*j));
+  void *buf = NULL;
+  size_t len = (size_t)n << c->page_shift;
+  if (!j || posix_memalign(&buf, buffer_alignment(c->page_size), len) != 0) {
+    free(j);
+    errno = ENOMEM;
+    return NULL;
+  }
+  j->h = h;
+  j->page_no = q;
+  j->npages = n;
+  j->off = page_off(c, q);
+  j->len = len;
+  j->gen = h->disk_gen;
+  j->data = (uint8_t*)buf;
+
+  pthread_mutex_lock(&g_fill.lock);
+  if (g_fill.tail) g_fill.tail->qnext = j; else g_fill.head = j;
+  g_fill.tail = j;
+  pthread_cond_signal(&g_fill.work);
+  pthread_mutex_unlock(&g_fill.lock);
+  return j;
+}
+
+/* Queue a read of blocks [q, q + n) (untagged) for h's cache. */
+static int fill_queue(vtpc_handle_t *h, uint64_t q, uint32_t n) {
+  fill_job_t *j = fill_submit(h, q, n);
+  if (!j) return -1;
+  j->next = h->fills;
+  h->fills = j;
+  return 0;
+}
+
+static int fill_covers(const fill_job_t *j, uint64_t first, uint64_t last) {
+  return j->page_no <= last && first < j->page_no + j->npages;
+}
+
+static int fill_pending(const vtpc_handle_t *h, uint64_t f) {
+  for (const fill_job_t *j = h->fills; j; j = j->next) {
+    if (fill_covers(j, f, f)) return 1;
+  }
+  return 0;
+}
+
+/* Finish j: wait for it if running, or take it back from the workers if
+ * still queued, to read it here or, without `read`, drop it unread. Under
+ * g_fill.lock. */
+static void fill_finish(fill_job_t *j, int read) {
+  if (j->state == FILL_QUEUED) {
+    fill_job_t **pp = &g_fill.head;
+    fill_job_t *prev = NULL;
+    while (*pp != j) { prev = *pp; pp = &(*pp)->qnext; }
+    *pp = j->qnext;
+    if (g_fill.tail == j) g_fill.tail = prev;
+    j->got = -1;
+    if (read) {
+      j->state = FILL_RUNNING;
+      pthread_mutex_unlock(&g_fill.lock);
+      ssize_t r = pread_fullpage(j->h, j->data, j->len, j->off);
+      int e = errno;
+      pthread_mutex_lock(&g_fill.lock);
+      j->got = r;
+      if (r < 0) j->err = e;
+    }
+    j->state = FILL_DONE;
+  }
+  while (j->state != FILL_DONE) pthread_cond_wait(&g_fill.done, &g_fill.lock);
+}
+
+/* fill_finish h's fills overlapping [first, last] (untagged). */
+static void fill_settle(vtpc_handle_t *h, uint64_t first, uint64_t last, int read) {
+  for (fill_job_t *j = h->fills; j; j = j->next) {
+    if (fill_covers(j, first, last)) fill_finish(j, read);
+  }
+}
+
+/* Install h's finished fills. A miss on page f (untagged) first finishes
+ * the fill covering it, so the block is never read twice; ~0ULL for none. */
+static void fill_reap(vtpc_handle_t *h, uint64_t f) {
+  fill_job_t *done = NULL;
+
+  pthread_mutex_lock(&g_fill.lock);
+  if (f != ~0ULL && !ht_get(&h->cache->resident, h->key_base | f)) fill_settle(h, f, f, 1);
+  for (fill_job_t **pp = &h->fills; *pp;) {
+    fill_job_t *j = *pp;
+    if (j->state != FILL_DONE) { pp = &j->next; continue; }
+    *pp = j->next;
+    j->next = done;
+    done = j;
+  }
+  pthread_mutex_unlock(&g_fill.lock);
+
+  int e = errno;
+  while (done) {
+    fill_job_t *j = done;
+    done = j->next;
+    if (j->got > 0 && j->gen == h->disk_gen) {
+      const span_t sp = {j->data, j->page_no, (size_t)j->got, j->gen};
+      (void)prefetch_range(h, PF_ADVISED, j->page_no, j->page_no + j->npages, ~0ULL, &sp);
+      h->async_fills++;
+    } else if (j->got > 0) {
+      h->async_stale++;
+    } else if (j->err) {
+      h->fill_err = j->err;
+    }
+    fill_free(j);
+  }
+  errno = e;
+}
+
+/* Drop h's fills overlapping [first, last] (untagged) unread. */
+static void fill_cancel(vtpc_handle_t *h, uint64_t first, uint64_t last) {
+  if (!h->fills) return;
+  pthread_mutex_lock(&g_fill.lock);
+  fill_settle(h, first, last, 0);
+  for (fill_job_t **pp = &h->fills; *pp;) {
+    fill_job_t *j = *pp;
+    if (!fill_covers(j, first, last)) { pp = &j->next; continue; }
+    *pp = j->next;
+    fill_free(j);
+  }
+  pthread_mutex_unlock(&g_fill.lock);
+}
+
+/* Close a classification window: loops first, since their passes look
+ * sequential; then write-once data, streams, strides and the rest. A loop
+ * more than twice the cache is a stream: too little of it would stay. */
+static void classify(vtpc_handle_t *h) {
+  unsigned n = h->cl_n;
+  size_t blocks = h->cache->capacity >> h->cache->page_shift;
+  if (h->cl_ticks < h->cl_loop_until && h->cl_loop_len <= 2 * blocks) {
+    h->cl = VTPC_ACCESS_LOOPING;
+  } else if (h->cl_write * 10 >= n * 9 && h->cl_new * 10 >= n * 9) {
+    h->cl = VTPC_ACCESS_WRITE_ONCE;
+  } else if (h->cl_seq + 1 >= n && !h->cl_reused) {
+    h->cl = VTPC_ACCESS_SEQUENTIAL;
+  } else if (h->pf_conf >= 2) {
+    h->cl = VTPC_ACCESS_STRIDED;
+  } else {
+    h->cl = VTPC_ACCESS_RANDOM;
+  }
+  h->cl_n = h->cl_seq = h->cl_write = h->cl_new = h->cl_reused = 0;
+}
+
+/* Feed page_no to the classifier and the prefetchers. Consecutive pages
+ * extend the current run; any other page starts a new one, and only run
+ * starts are looked at by the prefetchers. A jump back into a long run
+ * starts another pass of a loop. */
+static void access_observe(vtpc_handle_t *h, uint64_t page_no) {
+  uint64_t f = page_no & VTPC_FILE_PAGE_MASK;
+
+  h->pf_jump = 0;
+  if (f + 1 == h->pf_run_end) return;
+
+  int seq = (f == h->pf_run_end);
+  h->cl_ticks++;
+  h->cl_n++;
+  h->cl_seq += seq;
+  h->cl_write += h->cache->op_write;
+  if (f >= h->cl_hw) {
+    h->cl_new++;
+    h->cl_hw = f + 1;
+  }
+
+  uint64_t prev = h->pf_run_start;
+  uint64_t len = h->pf_run_end - h->pf_run_start;
+  if (seq) {
+    h->pf_run_end++;
+  } else {
+    h->pf_run_start = f;
+    h->pf_run_end = f + 1;
+    h->pf_jump = 1;
+    if (len >= 8 && f >= prev && f < prev + len) {
+      h->cl_loop_until = h->cl_ticks + 2 * len;
+      h->cl_loop_len = len;
+    }
+
+    int64_t d = (int64_t)(f - prev);
+    if (d == h->pf_stride && d != 0 && len) {
+      if (h->pf_conf < 8) h->pf_conf++;
+    } else {
+      h->pf_stride = d;
+      h->pf_conf = 0;
+    }
+  }
+
+  if (h->cl_n >= VTPC_CLASS_WINDOW && h->opts.access == VTPC_ACCESS_UNKNOWN) classify(h);
+  /* the prefetchers read synchronously: never in a non-blocking read */
+  if (seq || h->opts.prefetch == VTPC_PREFETCH_NONE || h->nowait) return;
+
+  int e = errno;
+  int strided = (h->pf_conf >= 2);
+  if (strided) stride_prefetch(h, f, h->pf_stride, len);
+  if (h->mk) {
+    if (h->mk_prev) markov_train(h, h->mk_prev - 1, prev, len);
+    h->mk_prev = prev + 1;
+    if (h->mk_backoff) {
+      h->mk_backoff--;
+    } else if (!strided && !ht_get(&h->cache->resident, page_no)) {
+      markov_prefetch(h, f);
+    }
+  }
+  errno = e;
+}
+
+/* Account a hit on resident p, as a read of it would. */
+static void cache_hit(vtpc_handle_t *h, page_entry_t *p) {
+  vtpc_cache_t *c = h->cache;
+  c->hits++;
+  if (c->tinylfu) sketch_add(&c->sketch, p->page_no);
+  if (p->pf) {
+    /* the first read of a prefetched extent is the miss it saved */
+    if (p->pf == PF_MARKOV) {
+      h->mk_hits++;
+      h->mk_win_hits++;
+      markov_judge(h);
+    } else if (p->pf == PF_STRIDE) {
+      h->pf_depth = min_sz(h->pf_depth + 1, VTPC_PREFETCH_MAX_DEPTH);
+    }
+    p->pf = 0;
+    h->prefetch_hits++;
+  } else if (p->side == SIDE_STREAM && (p->owner != h || h->pf_jump)) {
+    /* read again, not just further along the scan: no pure stream */
+    cache_dequeue(c, p, 0);
+    p->owner->cl_reused++;
+    cache_readmit(c, p);
+  } else if (p->side) {
+    /* a loop block keeps its place: the loop queue evicts by load order;
+     * a pinned one has none */
+  } else if (p->win) {
+    page_list_remove(&c->win_head, &c->win_tail, p);
+    page_list_push_front(&c->win_head, &c->win_tail, p);
+  } else {
+    c->pol->on_hit(c, p);
+  }
+}
+
+static page_entry_t* cache_get(vtpc_handle_t *h, uint64_t page_no) {
+  vtpc_cache_t *c = h->cache;
+
+  access_observe(h, page_no);
+  /* a non-blocking read reaped before it found page_no resident: installing
+   * more now could evict it, or write back a dirty victim */
+  if (h->fills && !h->nowait) fill_reap(h, page_no & VTPC_FILE_PAGE_MASK);
+
+  page_entry_t *p = (page_entry_t*)ht_get(&c->resident, page_no);
+  if (p) {
+    /* reading on into the extent it just read is the same reference: a
+     * scan in small reads must not promote every extent it passes */
+    if (p == h->last_ent && p->page_no <= h->last_page && h->last_page < page_no) {
+      c->hits++;
+    } else {
+      cache_hit(h, p);
+    }
+    h->last_ent = p;
+    h->last_page = page_no;
+    return p;
+  }
+  c->misses++;
+  h->misses++;
+
+  int hint = 0;
+  ghost_entry_t *g = (ghost_entry_t*)ht_get(&c->ghosts, page_no);
+  if (g) {
+    c->ghost_hits++;
+    hint = c->pol->on_ghost_hit(c, g);
+    cache_forget_ghost(c, g);
+  }
+
+  uint64_t start = 0;
+  uint32_t npages = extent_for_miss(h, page_no, &start);
+  p = cache_insert(h, start, npages, hint, NULL, 0);
+  if (!p) return NULL;
+  if (c->tinylfu) sketch_add(&c->sketch, p->page_no);
+  h->ra_next = start + npages;
+  h->last_ent = p;
+  h->last_page = page_no;
+  return p;
+}
+
+/* ---- Streaming ring: extents a sequential reader never caches ---- */
+
+static void ring_free(vtpc_handle_t *h) {
+  if (!h->ring) return;
+  for (unsigned i = 0; i < VTPC_RING_SLOTS; i++) free(h->ring[i].data);
+  free(h->ring);
+  h->ring = NULL;
+  h->ring_pages = 0;
+  h->ring_next = 0;
+}
+
+static int ring_alloc(vtpc_handle_t *h) {
+  vtpc_cache_t *c = h->cache;
+  size_t pages = h->opts.ra_max_pages;
+
+  h->ring = (ring_slot_t*)calloc(VTPC_RING_SLOTS, sizeof(*h->ring));
+  if (!h->ring) { errno = ENOMEM; return -1; }
+  for (unsigned i = 0; i < VTPC_RING_SLOTS; i++) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, buffer_alignment(c->page_size), pages << c->page_shift) != 0) {
+      ring_free(h);
+      errno = ENOMEM;
+      return -1;
+    }
+    h->ring[i].data = buf;
+  }
+  h->ring_pages = pages;
+  return 0;
+}
+
+/* Forget ring extents overlapping [off, off + len): the cache now holds
+ * newer data for them, and may write it back and evict it. */
+static void ring_invalidate(vtpc_handle_t *h, off_t off, size_t len) {
+  if (!h->ring || len == 0) return;
+  vtpc_cache_t *c = h->cache;
+  uint64_t first = h->key_base | ((uint64_t)off >> c->page_shift);
+  uint64_t last = h->key_base | (((uint64_t)off + len - 1) >> c->page_shift);
+
+  for (unsigned i = 0; i < VTPC_RING_SLOTS; i++) {
+    ring_slot_t *r = &h->ring[i];
+    if (r->npages && r->page_no <= last && first < r->page_no + r->npages) r->npages = 0;
+  }
+}
+
+/* The ring extent holding page_no, read from the file into the oldest slot
+ * when none does. Each read covers a full readahead ceiling, so a scan
+ * costs one pread per ra_max_pages blocks and no cache entries. Resident
+ * blocks in the range are copied over what was read: they may be dirty,
+ * and written back and evicted while the ring still holds them. */
+static ring_slot_t* ring_find(vtpc_handle_t *h, uint64_t page_no) {
+  for (unsigned i = 0; h->ring && i < VTPC_RING_SLOTS; i++) {
+    ring_slot_t *r = &h->ring[i];
+    if (r->npages && page_no >= r->page_no && page_no < r->page_no + r->npages) return r;
+  }
+  return NULL;
+}
+
+static ring_slot_t* ring_get(vtpc_handle_t *h, uint64_t page_no) {
+  vtpc_cache_t *c = h->cache;
+
+  ring_slot_t *r = ring_find(h, page_no);
+  if (r) return r;
+  if (!h->ring && ring_alloc(h) != 0) return NULL;
+
+  uint64_t eof_pages = h->key_base + (((uint64_t)h->size + c->page_mask) >> c->page_shift);
+  uint64_t n = min_sz(h->ring_pages, eof_pages > page_no ? eof_pages - page_no : 1);
+
+  r = &h->ring[h->ring_next];
+  h->ring_next = (h->ring_next + 1) % VTPC_RING_SLOTS;
+  r->npages = 0;
+
+  size_t len = (size_t)n << c->page_shift;
+  uint64_t t0 = now_ns();
+  ssize_t got = pread_fullpage(h, r->data, len, page_off(c, page_no));
+  if (got < 0) return NULL;
+  h->fill_ns = ewma_ns(h->fill_ns, (now_ns() - t0) / n);
+  if ((size_t)got < len) memset(r->data + got, 0, len - (size_t)got);
+
+  for (uint64_t q = page_no; q < page_no + n; q++) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, q);
+    if (p) {
+      memcpy(r->data + ((q - page_no) << c->page_shift),
+             (uint8_t*)p->data + ((q - p->page_no) << c->page_shift), c->page_size);
+    }
+  }
+
+  r->page_no = page_no;
+  r->npages = (uint32_t)n;
+  h->ring_fills++;
+  return r;
+}
+
+/* POSIX_FADV_WILLNEED: queue background reads of the blocks of
+ * [first, end) (untagged) that are neither resident nor queued, in extents
+ * of the longest length the cache takes, up to half the cache per call. */
+static int cache_willneed(vtpc_handle_t *h, uint64_t first, uint64_t end) {
+  vtpc_cache_t *c = h->cache;
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  uint64_t budget = max_sz((c->capacity >> c->page_shift) / 2, 1);
+  uint64_t max_pages = min_sz(max_extent_pages(c), budget);
+  if (end > eof_pages) end = eof_pages;
+
+  if (h->fills) fill_reap(h, ~0ULL);
+  uint64_t q = first;
+  while (q < end && budget) {
+    if (ht_get(&c->resident, h->key_base | q) || fill_pending(h, q)) { q++; continue; }
+
+    uint64_t r = q + 1;
+    while (r < end && r - q < min_sz(max_pages, budget) &&
+           !ht_get(&c->resident, h->key_base | r) && !fill_pending(h, r)) {
+      r++;
+    }
+    if (fill_queue(h, q, (uint32_t)(r - q)) != 0) return -1;
+    budget -= r - q;
+    q = r;
+  }
+  return 0;
+}
+
+/* POSIX_FADV_DONTNEED: write back and drop h's extents overlapping
+ * [first, last] (untagged), and forget reads queued or streamed for them. */
+static int cache_dontneed(vtpc_handle_t *h, uint64_t first, uint64_t last) {
+  fill_cancel(h, first, last);
+  for (unsigned i = 0; h->ring && i < VTPC_RING_SLOTS; i++) {
+    ring_slot_t *r = &h->ring[i];
+    uint64_t f = r->page_no & VTPC_FILE_PAGE_MASK;
+    if (r->npages && f <= last && first < f + r->npages) r->npages = 0;
+  }
+
+  page_entry_t *p = h->all_head;
+  while (p) {
+    page_entry_t *n = p->all_next;
+    uint64_t f = p->page_no & VTPC_FILE_PAGE_MASK;
+    if (f <= last && first < f + p->npages && !p->pins) {
+      p->pf = 0;  /* dropped on request: no verdict on the prefetcher */
+      if (cache_evict(h, p) != 0) return -1;
+    }
+    p = n;
+  }
+  return 0;
+}
+
+/* Pin an entry: off its queue, without leaving a ghost, until unpinned. */
+static void cache_pin_entry(vtpc_cache_t *c, page_entry_t *p) {
+  if (p->pins++) return;
+  cache_dequeue(c, p, 0);
+  p->side = SIDE_PIN;
+  c->pinned += entry_bytes(c, p);
+}
+
+/* Whether pinning blocks [first, last] (untagged) stays within the pin
+ * budget; ENOMEM if not. */
+static int cache_pin_fits(vtpc_handle_t *h, uint64_t first, uint64_t last) {
+  vtpc_cache_t *c = h->cache;
+  size_t need = 0;
+  for (uint64_t q = first; q <= last;) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    if (!p) { need += c->page_size; q++; continue; }
+    if (!p->pins) need += entry_bytes(c, p);
+    q = (p->page_no & VTPC_FILE_PAGE_MASK) + p->npages;
+  }
+  if (c->pinned + need > c->pin_cap) { errno = ENOMEM; return -1; }
+  return 0;
+}
+
+static void cache_unpin(vtpc_handle_t *h, uint64_t first, uint64_t last) {
+  vtpc_cache_t *c = h->cache;
+  for (uint64_t q = first; q <= last;) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    if (!p) { q++; continue; }
+    if (p->pins && --p->pins == 0) {
+      cache_dequeue(c, p, 0);
+      cache_readmit(c, p);
+    }
+    q = (p->page_no & VTPC_FILE_PAGE_MASK) + p->npages;
+  }
+}
+
+/* Pin the extents covering blocks [first, last] (untagged) below EOF,
+ * loading the missing ones, if that stays within the pin budget. */
+static int cache_pin(vtpc_handle_t *h, uint64_t first, uint64_t last) {
+  vtpc_cache_t *c = h->cache;
+  size_t max_pages = max_extent_pages(c);
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  if (last >= eof_pages) last = eof_pages - 1;
+  if (eof_pages == 0 || first > last) return 0;
+
+  if (h->fills) fill_reap(h, ~0ULL);
+  if (cache_pin_fits(h, first, last) != 0) return -1;
+
+  for (uint64_t q = first; q <= last;) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    if (!p) {
+      uint64_t r = q + 1;
+      while (r <= last && r - q < max_pages && !ht_get(&c->resident, h->key_base | r)) r++;
+      p = cache_insert(h, h->key_base | q, (uint32_t)(r - q), 0, NULL, 0);
+      if (!p) {
+        /* all or nothing: the caller cannot tell which extents got pinned */
+        int e = errno;
+        if (q > first) cache_unpin(h, first, q - 1);
+        errno = e;
+        return -1;
+      }
+    }
+    cache_pin_entry(c, p);
+    q = (p->page_no & VTPC_FILE_PAGE_MASK) + p->npages;
+  }
+  return 0;
+}
+
+static int cache_flush_all(vtpc_handle_t *h) {
+  if (h->maps) map_sync(h, 0, ~0ULL, 0);
+  for (page_entry_t *p = h->all_head; p; p = p->all_next) {
+    if (cache_flush_page(p) != 0) return -1;
+  }
+
+  if (fsync(h->os_fd) != 0) return -1;
+  if (ftruncate(h->os_fd, h->size) != 0) return -1;
+  return 0;
+}
+
+/* Free the resident entries of a cache with no handles left. */
+static void cache_destroy(vtpc_cache_t *c) {
+  if (c->pol) c->pol->destroy(c);
+  sketch_destroy(&c->sketch);
+
+  ht_destroy(&c->resident);
+  ht_destroy(&c->ghosts);
+  free(c);
+}
+
+static vtpc_cache_t* cache_create(const vtpc_opts *o) {
+  vtpc_cache_t *c = (vtpc_cache_t*)malloc(sizeof(*c));
+  if (!c) { errno = ENOMEM; return NULL; }
+  if (cache_init(c, o) != 0) {
+    int e = errno;
+    free(c);
+    errno = e;
+    return NULL;
+  }
+  return c;
+}
+
+/* Forget the ghosts and policy history of a pool slot's blocks, so that
+ * the next file opened into the slot starts without them. */
+static void cache_forget_slot(vtpc_cache_t *c, uint64_t key_base) {
+  for (size_t i = 0; i < c->ghosts.cap; i++) {
+    if (c->ghosts.state[i] != 1 || (c->ghosts.keys[i] & ~VTPC_FILE_PAGE_MASK) != key_base) {
+      continue;
+    }
+    /* frees every key of the ghost; deleting leaves the table in place */
+    cache_forget_ghost(c, (ghost_entry_t*)c->ghosts.vals[i]);
+  }
+  if (c->pol->forget_slot) c->pol->forget_slot(c, key_base);
+}
+
+/* Drop everything h has cached, without writing it back, and let go of the
+ * cache. A private cache is freed; a pool keeps its other handles' data. */
+static void cache_detach(vtpc_handle_t *h) {
+  vtpc_cache_t *c = h->cache;
+  int shared = (c->pool != 0);
+
+  page_entry_t *p = h->all_head;
   while (p) {
-    page_entry_t *n = p->next;
+    page_entry_t *n = p->all_next;
+    if (shared) cache_unlink(c, p);
     cache_free_page(p);
     p = n;
   }
+  h->all_head = NULL;
+  if (shared) cache_forget_slot(c, h->key_base);
+
+  if (--c->refs == 0 && !shared) cache_destroy(c);
+  h->cache = NULL;
+}
+
+static int cache_reinit(vtpc_handle_t *h, size_t page_size) {
+  fill_cancel(h, 0, ~0ULL);
+  if (cache_flush_all(h) != 0) return -1;
+
+  vtpc_opts o = h->opts;
+  o.block_size = page_size;
+  vtpc_cache_t *fresh = cache_create(&o);
+  if (!fresh) return -1;
+  cache_detach(h);
+  fresh->refs = 1;
+  h->cache = fresh;
+  h->opts = o;
+  h->ra_pages = 0;
+  h->ra_next = 0;
+  h->last_ent = NULL;
+  h->pf_run_start = h->pf_run_end = 0;
+  h->pf_conf = 0;
+  if (h->mk) memset(h->mk, 0, (h->mk_mask + 1) * sizeof(*h->mk));
+  h->mk_prev = 0;
+  ring_free(h);
+  return 0;
+}
+
+
+/* Copy [off, off + count) below EOF into buf. With nowait, stop at the
+ * first block that would need a read from the file and queue background
+ * reads for the rest of the range; -1 with EAGAIN if that is the first. */
+static ssize_t cache_read(vtpc_handle_t *h, void *buf, size_t count, off_t off, int nowait) {
+  vtpc_cache_t *c = h->cache;
+  c->op_seq++;
+  c->op_write = 0;
+  h->nowait = nowait;
+  size_t total = 0;
+  ssize_t rc = 0;
+  if (off < h->size && !range_fits(c, (uint64_t)off, min_sz(count, (size_t)(h->size - off)))) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+  if (h->maps) map_sync(h, (uint64_t)off, (uint64_t)off + count, 0);
+
+  while (total < count) {
+    off_t cur = off + (off_t)total;
+    if (cur >= h->size) break;
+
+    uint64_t page_no = h->key_base | ((uint64_t)cur >> c->page_shift);
+
+    if (nowait) {
+      if (h->fills) fill_reap(h, ~0ULL);
+      if (!ht_get(&c->resident, page_no) &&
+          !(h->cl == VTPC_ACCESS_SEQUENTIAL && ring_find(h, page_no))) {
+        uint64_t stop = (uint64_t)cur + min_sz(count - total, (size_t)(h->size - cur));
+        rc = -1;
+        if (h->fill_err) {
+          errno = h->fill_err;
+          h->fill_err = 0;
+        } else {
+          h->nowait_misses++;
+          if (cache_willneed(h, page_no & VTPC_FILE_PAGE_MASK,
+                             (stop + c->page_mask) >> c->page_shift) == 0) {
+            errno = EAGAIN;
+          }
+        }
+        break;
+      }
+    }
+
+    /* a streaming reader takes what is not resident from its ring; resident
+     * blocks may be dirty, so they always come from the cache */
+    uint64_t ext_page;
+    size_t ext_len;
+    const uint8_t *data;
+    if (h->fills && !nowait) fill_reap(h, page_no & VTPC_FILE_PAGE_MASK);
+    if (h->cl == VTPC_ACCESS_SEQUENTIAL && !ht_get(&c->resident, page_no)) {
+      access_observe(h, page_no);
+      ring_slot_t *r = ring_get(h, page_no);
+      if (!r) { rc = -1; break; }
+      ext_page = r->page_no;
+      ext_len = (size_t)r->npages << c->page_shift;
+      data = r->data;
+    } else {
+      page_entry_t *p = cache_get(h, page_no);
+      if (!p) { rc = -1; break; }
+      ext_page = p->page_no;
+      ext_len = entry_bytes(c, p);
+      data = p->data;
+    }
+
+    /* bytes past valid_len but below EOF are holes: the buffer holds zeros */
+    off_t ext_off = page_off(c, ext_page);
+    size_t in_ext = (size_t)(cur - ext_off);
+    size_t avail = min_sz(ext_len, (size_t)(h->size - ext_off)) - in_ext;
+    size_t take = min_sz(count - total, avail);
+
+    memcpy((uint8_t*)buf + total, data + in_ext, take);
+    total += take;
+  }
+
+  h->nowait = 0;
+  if (total > 0) return (ssize_t)total;
+  return rc;
+}
+
+/* Copy buf into [off, off + count), growing the file past its end. */
+static ssize_t cache_write(vtpc_handle_t *h, const void *buf, size_t count, off_t off) {
+  vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)off, count)) { errno = EFBIG; return -1; }
+  c->op_seq++;
+  c->op_write = 1;
+  ring_invalidate(h, off, count);
+  if (h->maps) map_sync(h, (uint64_t)off, (uint64_t)off + count, 1);
+
+  size_t total = 0;
+
+  while (total < count) {
+    off_t cur = off + (off_t)total;
+    uint64_t page_no = h->key_base | ((uint64_t)cur >> c->page_shift);
+
+    page_entry_t *p = cache_get(h, page_no);
+    if (!p) {
+      if (total > 0) return (ssize_t)total;
+      return -1;
+    }
+
+    size_t in_ext = (size_t)(cur - page_off(c, p->page_no));
+    size_t chunk = min_sz(count - total, entry_bytes(c, p) - in_ext);
+
+    if (in_ext > p->valid_len) {
+      memset((uint8_t*)p->data + p->valid_len, 0, in_ext - p->valid_len);
+    }
+
+    memcpy((uint8_t*)p->data + in_ext, (const uint8_t*)buf + total, chunk);
+
+    p->valid_len = max_sz(p->valid_len, in_ext + chunk);
+    size_t first = in_ext >> c->page_shift;
+    size_t last = (in_ext + chunk - 1) >> c->page_shift;
+    for (size_t i = first; i <= last; i++) p->dirty |= (uint64_t)1 << i;
+
+    total += chunk;
+
+    off_t new_end = off + (off_t)total;
+    if (new_end > h->size) {
+      h->size = new_end;
+      
+      if (ftruncate(h->os_fd, h->size) != 0) {
+        if (total > 0) return (ssize_t)total;
+        return -1;
+      }
+    }
+  }
+
+  return (ssize_t)total;
+}
+
+/* ---- vtpc_write_reserve / vtpc_write_commit: writes in place ---- */
+
+/* A block the reservation [off, end) overwrites whole, or past EOF: it
+ * needs no read. */
+static int resv_unread_block(const vtpc_handle_t *h, uint64_t q, uint64_t off, uint64_t end) {
+  uint64_t bs = q << h->cache->page_shift;
+  uint64_t be = bs + h->cache->page_size;
+  return (off <= bs && be <= end) || bs >= (uint64_t)h->size;
+}
+
+static int resv_is_unread(const vtpc_handle_t *h, uint64_t i) {
+  return (int)((h->resv_unread[i / 64] >> (i % 64)) & 1);
+}
+
+/* Pin the extents under [off, off + len) and point iov at their bytes of
+ * the range, up to iovcnt segments; returns how many. */
+static int cache_reserve(vtpc_handle_t *h, off_t off, size_t len, struct iovec *iov, int iovcnt) {
+  static const uint8_t zeros[1];
+  vtpc_cache_t *c = h->cache;
+  size_t max_pages = max_extent_pages(c);
+  uint64_t end = (uint64_t)off + len;
+  uint64_t first = (uint64_t)off >> c->page_shift;
+  uint64_t last = (end - 1) >> c->page_shift;
+
+  if (!range_fits(c, (uint64_t)off, len)) { errno = EFBIG; return -1; }
+  if (h->fills) fill_reap(h, ~0ULL);
+  if (cache_pin_fits(h, first, last) != 0) return -1;
+  uint64_t *unread = (uint64_t*)calloc((size_t)((last - first) / 64 + 1), sizeof(uint64_t));
+  if (!unread) { errno = ENOMEM; return -1; }
+  ring_invalidate(h, off, len);
+  if (h->maps) map_sync(h, (uint64_t)off, end, 1);
+
+  int k = 0;
+  uint64_t q = first;
+  while (q <= last && k < iovcnt) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    if (!p) {
+      /* the caller is about to overwrite what it covers whole: zero it */
+      int skip = resv_unread_block(h, q, (uint64_t)off, end);
+      uint64_t r = q + 1;
+      while (r <= last && r - q < max_pages && !ht_get(&c->resident, h->key_base | r) &&
+             resv_unread_block(h, r, (uint64_t)off, end) == skip) {
+        r++;
+      }
+      p = cache_insert(h, h->key_base | q, (uint32_t)(r - q), 0, skip ? zeros : NULL, 0);
+      if (!p) break;
+      for (uint64_t b = q; skip && b < r; b++) {
+        unread[(b - first) / 64] |= (uint64_t)1 << ((b - first) % 64);
+      }
+    }
+    cache_pin_entry(c, p);
+
+    uint64_t ext_off = (uint64_t)page_off(c, p->page_no);
+    uint64_t lo = max_sz((size_t)off, (size_t)ext_off);
+    uint64_t hi = min_sz((size_t)end, (size_t)(ext_off + entry_bytes(c, p)));
+    iov[k].iov_base = (uint8_t*)p->data + (lo - ext_off);
+    iov[k].iov_len = (size_t)(hi - lo);
+    k++;
+    q = (p->page_no & VTPC_FILE_PAGE_MASK) + p->npages;
+  }
+  if (k == 0) {
+    free(unread);
+    return -1;
+  }
+
+  h->resv_off = off;
+  h->resv_len = (size_t)(min_sz((size_t)end, (size_t)(q << c->page_shift)) - (uint64_t)off);
+  h->resv_unread = unread;
+  return k;
+}
+
+/* End the reservation with [off, off + len) written: mark it dirty and
+ * grow the file over it. Blocks handed out zeroed get the file's bytes
+ * back wherever they were not written. */
+static int cache_commit(vtpc_handle_t *h, off_t off, size_t len) {
+  vtpc_cache_t *c = h->cache;
+  uint64_t first = (uint64_t)h->resv_off >> c->page_shift;
+  uint64_t last = ((uint64_t)h->resv_off + h->resv_len - 1) >> c->page_shift;
+  uint64_t lo = (uint64_t)off, hi = (uint64_t)off + len;
+  uint64_t old = (uint64_t)h->size;
+  void *tmp = NULL;
+
+  for (uint64_t q = first; q <= last; q++) {
+    uint64_t bs = q << c->page_shift;
+    uint64_t be = min_sz((size_t)(bs + c->page_size), (size_t)old);
+    if (!resv_is_unread(h, q - first) || bs >= be || (lo <= bs && be <= hi)) continue;
+
+    if (!tmp && posix_memalign(&tmp, buffer_alignment(c->page_size), c->page_size) != 0) {
+      errno = ENOMEM;
+      return -1;
+    }
+    ssize_t got = pread_fullpage(h, tmp, c->page_size, (off_t)bs);
+    if (got < 0) {
+      free(tmp);
+      return -1;
+    }
+    if ((size_t)got < c->page_size) memset((uint8_t*)tmp + got, 0, c->page_size - (size_t)got);
+
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    uint8_t *dst = (uint8_t*)p->data + ((q - (p->page_no & VTPC_FILE_PAGE_MASK)) << c->page_shift);
+    if (lo > bs) memcpy(dst, tmp, (size_t)(min_sz((size_t)be, (size_t)lo) - bs));
+    if (hi < be) {
+      size_t from = (size_t)(max_sz((size_t)bs, (size_t)hi) - bs);
+      memcpy(dst + from, (uint8_t*)tmp + from, (size_t)(be - bs) - from);
+    }
+  }
+  free(tmp);
+
+  int rc = 0;
+  if (len) {
+    uint64_t l = (hi - 1) >> c->page_shift;
+    for (uint64_t q = lo >> c->page_shift; q <= l;) {
+      page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+      uint64_t f = p->page_no & VTPC_FILE_PAGE_MASK;
+      for (; q < f + p->npages && q <= l; q++) p->dirty |= (uint64_t)1 << (q - f);
+    }
+    if (hi > old) {
+      h->size = (off_t)hi;
+      if (ftruncate(h->os_fd, h->size) != 0) rc = -1;
+    }
+  }
+
+  /* the buffers now hold the file up to EOF: no hole below it to zero */
+  for (uint64_t q = first; q <= last;) {
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    uint64_t ext_off = (uint64_t)page_off(c, p->page_no);
+    if ((uint64_t)h->size > ext_off) {
+      p->valid_len = max_sz(p->valid_len,
+                            min_sz(entry_bytes(c, p), (size_t)((uint64_t)h->size - ext_off)));
+    }
+    q = (p->page_no & VTPC_FILE_PAGE_MASK) + p->npages;
+  }
+  cache_unpin(h, first, last);
+  ring_invalidate(h, h->resv_off, h->resv_len);
+  if (h->maps) map_sync(h, (uint64_t)h->resv_off, (uint64_t)h->resv_off + h->resv_len, 1);
+  free(h->resv_unread);
+  h->resv_unread = NULL;
+  h->resv_len = 0;
+  return rc;
+}
+
+/* ---- vtpc_read_batch: every lookup first, then the misses in order ---- */
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return (x > y) - (x < y);
+}
+
+/* Sort and deduplicate v[0, n); returns the new length. */
+static size_t sort_unique(uint64_t *v, size_t n) {
+  if (n == 0) return 0;
+  qsort(v, n, sizeof(*v), cmp_u64);
+  size_t k = 1;
+  for (size_t i = 1; i < n; i++) {
+    if (v[i] != v[k - 1]) v[k++] = v[i];
+  }
+  return k;
+}
+
+static void batch_free(batch_t *b) {
+  for (size_t i = 0; i < b->nbufs; i++) free(b->bufs[i]);
+  free(b->bufs);
+  free(b->miss);
+  free(b->at);
+  free(b->avail);
+  memset(b, 0, sizeof(*b));
+}
+
+/* Neither resident nor coming from a background read. */
+static int batch_missing(vtpc_handle_t *h, uint64_t q) {
+  return !ht_get(&h->cache->resident, h->key_base | q) && !(h->fills && fill_pending(h, q));
+}
+
+/* Look every block of reqs up, then read the missing ones in offset order,
+ * merging runs that are close, into b; up to a cache's worth of them. Best
+ * effort: what is not read here is read by the misses themselves. */
+static void batch_prepare(vtpc_handle_t *h, const vtpc_req *reqs, size_t n, batch_t *b) {
+  vtpc_cache_t *c = h->cache;
+  if (h->fills) fill_reap(h, ~0ULL);
+  for (size_t i = 0; h->maps && i < n; i++) {
+    if (reqs[i].offset < 0) continue;
+    map_sync(h, (uint64_t)reqs[i].offset, (uint64_t)reqs[i].offset + reqs[i].len, 0);
+  }
+  /* a streaming handle reads what is not resident through its ring */
+  if (h->cl == VTPC_ACCESS_SEQUENTIAL) return;
+
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  size_t ext = h->opts.extent_pages ? min_sz(h->opts.extent_pages, max_extent_pages(c)) : 1;
+  size_t total = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass) {
+      if (total == 0) return;
+      b->miss = (uint64_t*)malloc(total * sizeof(uint64_t));
+      if (!b->miss) return;
+      total = 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+      const vtpc_req *r = &reqs[i];
+      if (r->len == 0 || r->offset < 0 || r->offset >= h->size ||
+          !range_fits(c, (uint64_t)r->offset, r->len)) {
+        continue;
+      }
+      uint64_t first = (uint64_t)r->offset >> c->page_shift;
+      uint64_t end = ((uint64_t)r->offset + r->len + c->page_mask) >> c->page_shift;
+      if (end > eof_pages) end = eof_pages;
+      for (uint64_t q = first; q < end; q++) {
+        if (pass) b->miss[total] = q;
+        total++;
+      }
+    }
+  }
+  uint64_t *pages = b->miss;
+
+  /* probe ahead of the lookups: the table is too large to stay in cache */
+  size_t nmiss = 0;
+  for (size_t k = 0; k < total; k++) {
+    if (k + VTPC_BATCH_LOOKAHEAD < total) {
+      ht_prefetch(&c->resident, h->key_base | pages[k + VTPC_BATCH_LOOKAHEAD]);
+    }
+    if (batch_missing(h, pages[k])) pages[nmiss++] = pages[k];
+  }
+  nmiss = sort_unique(pages, nmiss);
+
+  /* a miss loads the whole of a fixed extent but for its resident blocks */
+  if (ext > 1 && nmiss) {
+    uint64_t *all = (uint64_t*)malloc(nmiss * ext * sizeof(*all));
+    if (!all) {
+      batch_free(b);
+      return;
+    }
+    size_t m = 0;
+    for (size_t i = 0; i < nmiss; i++) {
+      uint64_t s = pages[i] & ~(uint64_t)(ext - 1);
+      if (m && all[m - 1] >= s) continue;
+      for (uint64_t q = s; q < s + ext && q < eof_pages; q++) {
+        if (q == pages[i] || batch_missing(h, q)) all[m++] = q;
+      }
+    }
+    free(pages);
+    b->miss = pages = all;
+    nmiss = m;
+  }
+  b->nmiss = nmiss;
+  b->at = (uint8_t**)calloc(nmiss, sizeof(*b->at));
+  b->avail = (size_t*)calloc(nmiss, sizeof(*b->avail));
+  b->bufs = (uint8_t**)calloc(nmiss, sizeof(*b->bufs));
+  if (!b->at || !b->avail || !b->bufs) {
+    batch_free(b);
+    return;
+  }
+
+  uint64_t gap = VTPC_BATCH_GAP >> c->page_shift;
+  uint64_t most = max_sz(VTPC_BATCH_READ >> c->page_shift, max_extent_pages(c));
+  uint64_t budget = c->capacity >> c->page_shift;
+  for (size_t i = 0; i < nmiss;) {
+    size_t j = i + 1;
+    while (j < nmiss && pages[j] - pages[i] < most && pages[j] - pages[j - 1] - 1 <= gap) j++;
+    uint64_t lo = pages[i], hi = pages[j - 1] + 1;
+    if (hi - lo > budget) break;
+
+    size_t len = (size_t)(hi - lo) << c->page_shift;
+    void *buf = NULL;
+    if (posix_memalign(&buf, buffer_alignment(c->page_size), len) != 0) break;
+    uint64_t t0 = now_ns();
+    ssize_t got = pread_fullpage(h, buf, len, page_off(c, lo));
+    if (got < 0) {
+      /* the reads that need these blocks will fail on their own */
+      free(buf);
+      i = j;
+      continue;
+    }
+    h->fill_ns = ewma_ns(h->fill_ns, (now_ns() - t0) / (hi - lo));
+    h->batch_reads++;
+    budget -= hi - lo;
+    b->bufs[b->nbufs++] = (uint8_t*)buf;
+    for (; i < j; i++) {
+      size_t at = (size_t)(pages[i] - lo) << c->page_shift;
+      b->at[i] = (uint8_t*)buf + at;
+      b->avail[i] = (size_t)got > at ? (size_t)got - at : 0;
+    }
+  }
+}
+
+/* ---- vtpc_submit / vtpc_reap ----
+ *
+ * Requests run on the caller's thread like vtpc_read and vtpc_write, but a
+ * read stops at its first miss instead of waiting: the blocks it lacks are
+ * queued on the fill workers and the read waits on h->aio, resuming from
+ * where it stopped whenever vtpc_reap finds its next block resident. */
+
+typedef struct aio_req {
+  void *buf;
+  size_t len;
+  off_t off;
+  size_t done;             /* bytes copied so far */
+  unsigned long long tag;
+  struct aio_req *next;
+} aio_req_t;
+
+static void aio_free(vtpc_handle_t *h) {
+  while (h->aio) {
+    aio_req_t *r = h->aio;
+    h->aio = r->next;
+    free(r);
+  }
+  h->aio_tail = NULL;
+  h->aio_n = 0;
+  free(h->events);
+  h->events = NULL;
+  h->nevents = h->events_cap = 0;
+}
+
+/* Room for n more completions, on top of the reads in flight. */
+static int aio_reserve(vtpc_handle_t *h, size_t n) {
+  size_t need = h->nevents + h->aio_n + n;
+  if (need <= h->events_cap) return 0;
+  size_t cap = max_sz(need, 2 * h->events_cap);
+  vtpc_event *ev = (vtpc_event*)realloc(h->events, cap * sizeof(*ev));
+  if (!ev) { errno = ENOMEM; return -1; }
+  h->events = ev;
+  h->events_cap = cap;
+  return 0;
+}
+
+static void aio_complete(vtpc_handle_t *h, unsigned long long tag, ssize_t res) {
+  h->events[h->nevents].tag = tag;
+  h->events[h->nevents].res = res;
+  h->nevents++;
+}
+
+/* Carry a read on; 1 once it has completed. Without nowait it always does. */
+static int aio_step(vtpc_handle_t *h, aio_req_t *r, int nowait) {
+  while (r->done < r->len) {
+    ssize_t got = cache_read(h, (uint8_t*)r->buf + r->done, r->len - r->done,
+                             r->off + (off_t)r->done, nowait);
+    if (got == 0) break;
+    if (got < 0) {
+      if (errno == EAGAIN) return 0;
+      if (r->done == 0) {
+        aio_complete(h, r->tag, -errno);
+        return 1;
+      }
+      break;
+    }
+    r->done += (size_t)got;
+  }
+  aio_complete(h, r->tag, (ssize_t)r->done);
+  return 1;
+}
+
+/* Carry every read in flight on, in order, without waiting. */
+static void aio_poll(vtpc_handle_t *h) {
+  aio_req_t *prev = NULL;
+  for (aio_req_t *r = h->aio; r;) {
+    aio_req_t *next = r->next;
+    if (!aio_step(h, r, 1)) {
+      prev = r;
+    } else {
+      if (prev) prev->next = next; else h->aio = next;
+      if (h->aio_tail == r) h->aio_tail = prev;
+      h->aio_n--;
+      free(r);
+    }
+    r = next;
+  }
+}
+
+static void aio_signal(vtpc_handle_t *h) {
+  if (h->efd >= 0) {
+    uint64_t one = 1;
+    (void)!write(h->efd, &one, sizeof(one));
+  }
+}
+
+/* ---- vtpc_scan: the range in place, without copies ----
+ *
+ * Resident blocks are handed to the callback where they are. The runs of
+ * blocks between them go to the fill workers, up to VTPC_RING_SLOTS runs of
+ * ra_max_pages blocks ahead of the callback, into buffers of the scan's
+ * own that never enter the cache. Nothing is written meanwhile, so a run
+ * read ahead still matches the file when its turn comes. */
+
+typedef struct scan {
+  vtpc_handle_t *h;
+  uint64_t next;           /* first block not looked at for reads (untagged) */
+  uint64_t end;            /* block past the range */
+  fill_job_t *head;        /* reads ahead, in file order */
+  fill_job_t *tail;
+  unsigned n;
+} scan_t;
+
+/* Queue reads of the next runs of blocks not resident. */
+static int scan_ahead(scan_t *s) {
+  vtpc_handle_t *h = s->h;
+  vtpc_cache_t *c = h->cache;
+
+  while (s->n < VTPC_RING_SLOTS && s->next < s->end) {
+    uint64_t q = s->next;
+    if (ht_get(&c->resident, h->key_base | q)) { s->next++; continue; }
+    uint64_t r = q + 1;
+    while (r < s->end && r - q < h->opts.ra_max_pages && !ht_get(&c->resident, h->key_base | r)) {
+      r++;
+    }
+    fill_job_t *j = fill_submit(h, q, (uint32_t)(r - q));
+    if (!j) return -1;
+    if (s->tail) s->tail->next = j; else s->head = j;
+    s->tail = j;
+    s->n++;
+    s->next = r;
+    h->scan_reads++;
+  }
+  return 0;
+}
+
+/* Drop the reads ahead ending before block q, all of them for ~0ULL. */
+static void scan_drop(scan_t *s, uint64_t q) {
+  while (s->head && (q == ~0ULL || s->head->page_no + s->head->npages <= q)) {
+    fill_job_t *j = s->head;
+    pthread_mutex_lock(&g_fill.lock);
+    fill_finish(j, 0);
+    pthread_mutex_unlock(&g_fill.lock);
+    s->head = j->next;
+    if (!s->head) s->tail = NULL;
+    s->n--;
+    fill_free(j);
+  }
+}
+
+static int cache_scan(vtpc_handle_t *h, uint64_t off, uint64_t stop, vtpc_scan_fn cb, void *ctx,
+                      unsigned flags) {
+  vtpc_cache_t *c = h->cache;
+  scan_t s;
+  memset(&s, 0, sizeof(s));
+  s.h = h;
+  s.next = off >> c->page_shift;
+  s.end = (stop + c->page_mask) >> c->page_shift;
+
+  int rc = 0;
+  uint64_t cur = off;
+  while (cur < stop) {
+    uint64_t q = cur >> c->page_shift;
+    const uint8_t *data;
+    uint64_t ext_page;
+    size_t ext_len;
+
+    page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | q);
+    if (p) {
+      if (flags & VTPC_SCAN_TOUCH) {
+        h->pf_jump = 0;
+        cache_hit(h, p);
+      }
+      data = p->data;
+      ext_page = p->page_no;
+      ext_len = entry_bytes(c, p);
+    } else {
+      scan_drop(&s, q);
+      if (scan_ahead(&s) != 0 && !s.head) { rc = -1; break; }
+      fill_job_t *j = s.head;
+      if (j && j->page_no <= q) {
+        pthread_mutex_lock(&g_fill.lock);
+        fill_finish(j, 1);
+        pthread_mutex_unlock(&g_fill.lock);
+        if (j->got < 0) {
+          errno = j->err;
+          rc = -1;
+          break;
+        }
+        if ((size_t)j->got < j->len) {
+          memset(j->data + j->got, 0, j->len - (size_t)j->got);
+          j->got = (ssize_t)j->len;
+        }
+        /* up to the first block resident since: it may be newer */
+        uint64_t r = q + 1;
+        while (r < j->page_no + j->npages && !ht_get(&c->resident, h->key_base | r)) r++;
+        data = j->data;
+        ext_page = j->page_no;
+        ext_len = (size_t)(r - j->page_no) << c->page_shift;
+      } else {
+        /* evicted since it was looked at: read it as a stream would */
+        ring_slot_t *r = ring_get(h, h->key_base | q);
+        if (!r) { rc = -1; break; }
+        data = r->data;
+        ext_page = r->page_no;
+        ext_len = (size_t)r->npages << c->page_shift;
+      }
+    }
+
+    uint64_t ext_off = (uint64_t)page_off(c, ext_page);
+    size_t in_ext = (size_t)(cur - ext_off);
+    size_t n = min_sz(ext_len - in_ext, (size_t)(stop - cur));
+    rc = cb(data + in_ext, n, (off_t)cur, ctx);
+    if (rc != 0) break;
+    cur += n;
+  }
+
+  int e = errno;
+  scan_drop(&s, ~0ULL);
+  errno = e;
+  return rc;
+}
+
+/* ---- vtpc_mmap: file ranges mapped through the cache ----
+ *
+ * A mapping is anonymous memory registered with userfaultfd. One thread of
+ * ours serves its faults: a missing page is copied in from the block's
+ * cache entry, write-protected, and the first store to it faults again to
+ * mark it dirty. Before an entry is evicted the dirty pages over it are
+ * copied back into it and every page over it is unmapped, so a present
+ * page always has its block resident. A page whose block cannot be read is
+ * poisoned, so the access raises SIGBUS; kernels without UFFDIO_POISON
+ * keep the faulting thread waiting while the read is retried. Faults are
+ * served under g_map.lock, which the cache's own calls into the mappings
+ * take as well; it is recursive because serving a fault may evict, which
+ * calls back. The lock does not cover the handles: the fault thread uses
+ * the cache only while the thread that owns it is blocked in the fault. */
+
+#ifdef __linux__
+
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
+#ifndef UFFDIO_POISON
+struct uffdio_poison {
+  struct uffdio_range range;
+  uint64_t mode;
+  int64_t updated;
+};
+#define UFFDIO_POISON _IOWR(UFFDIO, 0x08, struct uffdio_poison)
+#endif
+
+enum { MAP_PRESENT = 1, MAP_DIRTY = 2 };
+
+typedef struct map {
+  vtpc_handle_t *h;
+  uint8_t *addr;
+  size_t len;              /* whole system pages */
+  uint64_t off;
+  uint8_t *state;          /* MAP_* per system page */
+  struct map *next;
+} map_t;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_once_t once;
+  int err;                 /* errno of a failed setup */
+  int uffd;
+  int wp;                  /* stores to present pages are reported */
+  size_t page;             /* system page size */
+  map_t *head;
+  int n;                   /* mappings, read without the lock */
+} g_map = {PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP, PTHREAD_ONCE_INIT, 0, -1, 0, 0, NULL, 0};
+
+static int map_uffd(int flags) {
+  int fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | flags | UFFD_USER_MODE_ONLY);
+  if (fd < 0 && errno == EINVAL) fd = (int)syscall(SYS_userfaultfd, O_CLOEXEC | flags);
+  return fd;
+}
+
+/* Copy what page i of m holds below EOF back into its cache entry. Like
+ * a vtpc_write, that drops any ring copy of the bytes. */
+static void map_copy_back(map_t *m, size_t i) {
+  vtpc_handle_t *h = m->h;
+  vtpc_cache_t *c = h->cache;
+  uint64_t off = m->off + i * g_map.page;
+  if (off >= (uint64_t)h->size) return;
+  page_entry_t *p = (page_entry_t*)ht_get(&c->resident, h->key_base | (off >> c->page_shift));
+  if (!p) return;
+
+  size_t in_ext = (size_t)(off - (uint64_t)page_off(c, p->page_no));
+  size_t n = min_sz(g_map.page, (size_t)((uint64_t)h->size - off));
+  if (in_ext > p->valid_len) memset((uint8_t*)p->data + p->valid_len, 0, in_ext - p->valid_len);
+  memcpy((uint8_t*)p->data + in_ext, m->addr + i * g_map.page, n);
+  p->valid_len = max_sz(p->valid_len, in_ext + n);
+  p->dirty |= (uint64_t)1 << (in_ext >> c->page_shift);
+  ring_invalidate(h, (off_t)off, n);
+}
+
+/* Pages [i, e) of m: copy the dirty ones back, then unmap them all with
+ * drop, or write-protect them again without. */
+static void map_writeback(map_t *m, size_t i, size_t e, int drop) {
+  for (size_t k = i; k < e; k++) {
+    if (!(m->state[k] & MAP_DIRTY)) continue;
+    if (!drop && g_map.wp) {
+      struct uffdio_writeprotect wp;
+      wp.range.start = (uintptr_t)(m->addr + k * g_map.page);
+      wp.range.len = g_map.page;
+      wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+      if (ioctl(g_map.uffd, UFFDIO_WRITEPROTECT, &wp) == 0) m->state[k] = MAP_PRESENT;
+    }
+    map_copy_back(m, k);
+  }
+  if (drop && e > i) {
+    (void)madvise(m->addr + i * g_map.page, (e - i) * g_map.page, MADV_DONTNEED);
+    memset(m->state + i, 0, e - i);
+  }
+}
 
-  ghost_entry_t *g = c->a1out_head;
-  while (g) {
-    ghost_entry_t *n = g->next;
-    cache_free_ghost(g);
-    g = n;
+/* Bring what h's mappings hold over file bytes [lo, hi) back into the
+ * cache; with drop, unmap those pages too. */
+static void map_sync(vtpc_handle_t *h, uint64_t lo, uint64_t hi, int drop) {
+  pthread_mutex_lock(&g_map.lock);
+  for (map_t *m = g_map.head; m; m = m->next) {
+    if (m->h != h || hi <= m->off || m->off + m->len <= lo) continue;
+    uint64_t from = lo > m->off ? lo - m->off : 0;
+    uint64_t to = min_sz((size_t)(hi - m->off), m->len);
+    map_writeback(m, (size_t)(from / g_map.page),
+                  (size_t)((to + g_map.page - 1) / g_map.page), drop);
   }
+  pthread_mutex_unlock(&g_map.lock);
+}
 
-  ht_destroy(&c->resident);
-  ht_destroy(&c->ghosts);
-  memset(c, 0, sizeof(*c));
+/* Serve the fault at addr; -1 when its block could not be read and the
+ * page could not be poisoned either, so the faulting thread still waits. */
+static int map_fault(uintptr_t addr, uint64_t flags) {
+  map_t *m = g_map.head;
+  while (m && !((uintptr_t)m->addr <= addr && addr < (uintptr_t)m->addr + m->len)) m = m->next;
+  if (!m) return 0;  /* unmapped meanwhile, which woke the faulting thread */
+
+  size_t i = (addr - (uintptr_t)m->addr) / g_map.page;
+  uint8_t *page = m->addr + i * g_map.page;
+  if (flags & UFFD_PAGEFAULT_FLAG_WP) {
+    struct uffdio_writeprotect wp;
+    wp.range.start = (uintptr_t)page;
+    wp.range.len = g_map.page;
+    wp.mode = 0;
+    m->state[i] |= MAP_DIRTY;
+    (void)ioctl(g_map.uffd, UFFDIO_WRITEPROTECT, &wp);
+    return 0;
+  }
+  if (m->state[i] & MAP_PRESENT) {
+    /* a second report of a fault already served */
+    struct uffdio_range range;
+    range.start = (uintptr_t)page;
+    range.len = g_map.page;
+    (void)ioctl(g_map.uffd, UFFDIO_WAKE, &range);
+    return 0;
+  }
+
+  vtpc_handle_t *h = m->h;
+  vtpc_cache_t *c = h->cache;
+  uint64_t off = m->off + i * g_map.page;
+  page_entry_t *p = cache_get(h, h->key_base | (off >> c->page_shift));
+  if (!p) {
+    /* never zeros in place of data: the access raises SIGBUS, as a read
+     * error under a mapped file does */
+    struct uffdio_poison ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.range.start = (uintptr_t)page;
+    ps.range.len = g_map.page;
+    if (ioctl(g_map.uffd, UFFDIO_POISON, &ps) == 0 || errno == EEXIST) return 0;
+    return -1;
+  }
+
+  /* without write faults every page counts as written */
+  int write = (flags & UFFD_PAGEFAULT_FLAG_WRITE) || !g_map.wp;
+  struct uffdio_copy cp;
+  memset(&cp, 0, sizeof(cp));
+  cp.dst = (uintptr_t)page;
+  cp.src = (uintptr_t)p->data + (off - (uint64_t)page_off(c, p->page_no));
+  cp.len = g_map.page;
+  cp.mode = write ? 0 : UFFDIO_COPY_MODE_WP;
+  while (ioctl(g_map.uffd, UFFDIO_COPY, &cp) != 0 && errno == EAGAIN) cp.copy = 0;
+  m->state[i] = (uint8_t)(MAP_PRESENT | (write ? MAP_DIRTY : 0));
+  h->map_faults++;
+  return 0;
+}
+
+static void* map_worker(void *arg) {
+  (void)arg;
+  for (;;) {
+    struct uffd_msg msg;
+    ssize_t r = read(g_map.uffd, &msg, sizeof(msg));
+    if (r != (ssize_t)sizeof(msg) || msg.event != UFFD_EVENT_PAGEFAULT) continue;
+    pthread_mutex_lock(&g_map.lock);
+    while (map_fault((uintptr_t)msg.arg.pagefault.address, msg.arg.pagefault.flags) != 0) {
+      const struct timespec retry = {0, 10 * 1000 * 1000};
+      pthread_mutex_unlock(&g_map.lock);
+      nanosleep(&retry, NULL);
+      pthread_mutex_lock(&g_map.lock);
+    }
+    pthread_mutex_unlock(&g_map.lock);
+  }
+  return NULL;
+}
+
+/* Open the process's userfaultfd, asking for write faults where the kernel
+ * has them, and start its thread with every signal blocked. */
+static void map_setup(void) {
+  g_map.page = vtpc_page_size();
+  struct uffdio_api api;
+  int fd = map_uffd(0);
+  if (fd < 0) { g_map.err = errno; return; }
+  memset(&api, 0, sizeof(api));
+  api.api = UFFD_API;
+  api.features = UFFD_FEATURE_PAGEFAULT_FLAG_WP;
+  if (ioctl(fd, UFFDIO_API, &api) == 0) {
+    g_map.wp = 1;
+  } else {
+    /* the handshake happens once per descriptor */
+    close(fd);
+    if ((fd = map_uffd(0)) < 0) { g_map.err = errno; return; }
+    memset(&api, 0, sizeof(api));
+    api.api = UFFD_API;
+    if (ioctl(fd, UFFDIO_API, &api) != 0) {
+      g_map.err = errno;
+      close(fd);
+      return;
+    }
+  }
+
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  pthread_t t;
+  int rc = pthread_create(&t, NULL, map_worker, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (rc != 0) {
+    g_map.err = EAGAIN;
+    close(fd);
+    return;
+  }
+  pthread_detach(t);
+  g_map.uffd = fd;
+}
+
+static void* map_create(vtpc_handle_t *h, uint64_t off, size_t len) {
+  pthread_once(&g_map.once, map_setup);
+  if (g_map.err) { errno = g_map.err; return NULL; }
+  if (h->cache->page_size < g_map.page || off % g_map.page) { errno = EINVAL; return NULL; }
+
+  len = (len + g_map.page - 1) & ~(g_map.page - 1);
+  map_t *m = (map_t*)calloc(1, sizeof(*m));
+  uint8_t *state = (uint8_t*)calloc(len / g_map.page, 1);
+  if (!m || !state) {
+    free(m);
+    free(state);
+    errno = ENOMEM;
+    return NULL;
+  }
+  int prot = (h->flags & O_ACCMODE) == O_RDONLY ? PROT_READ : PROT_READ | PROT_WRITE;
+  void *addr = mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    free(m);
+    free(state);
+    return NULL;
+  }
+
+  struct uffdio_register reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.range.start = (uintptr_t)addr;
+  reg.range.len = len;
+  reg.mode = UFFDIO_REGISTER_MODE_MISSING | (g_map.wp ? UFFDIO_REGISTER_MODE_WP : 0);
+  if (ioctl(g_map.uffd, UFFDIO_REGISTER, &reg) != 0) {
+    int e = errno;
+    munmap(addr, len);
+    free(m);
+    free(state);
+    errno = e;
+    return NULL;
+  }
+
+  m->h = h;
+  m->addr = (uint8_t*)addr;
+  m->len = len;
+  m->off = off;
+  m->state = state;
+  pthread_mutex_lock(&g_map.lock);
+  m->next = g_map.head;
+  g_map.head = m;
+  __atomic_add_fetch(&g_map.n, 1, __ATOMIC_RELEASE);
+  h->maps++;
+  pthread_mutex_unlock(&g_map.lock);
+  return addr;
+}
+
+static void map_destroy(map_t *m) {
+  pthread_mutex_lock(&g_map.lock);
+  map_writeback(m, 0, m->len / g_map.page, 0);
+  map_t **pp = &g_map.head;
+  while (*pp != m) pp = &(*pp)->next;
+  *pp = m->next;
+  __atomic_sub_fetch(&g_map.n, 1, __ATOMIC_RELEASE);
+  m->h->maps--;
+  pthread_mutex_unlock(&g_map.lock);
+
+  struct uffdio_range range;
+  range.start = (uintptr_t)m->addr;
+  range.len = m->len;
+  (void)ioctl(g_map.uffd, UFFDIO_UNREGISTER, &range);
+  munmap(m->addr, m->len);
+  free(m->state);
+  free(m);
+}
+
+static int map_remove(void *addr, size_t len) {
+  if (!__atomic_load_n(&g_map.n, __ATOMIC_ACQUIRE)) { errno = EINVAL; return -1; }
+  len = (len + g_map.page - 1) & ~(g_map.page - 1);
+  pthread_mutex_lock(&g_map.lock);
+  map_t *m = g_map.head;
+  while (m && !(m->addr == (uint8_t*)addr && m->len == len)) m = m->next;
+  pthread_mutex_unlock(&g_map.lock);
+  if (!m) { errno = EINVAL; return -1; }
+  map_destroy(m);
+  return 0;
+}
+
+static void map_close(vtpc_handle_t *h) {
+  pthread_mutex_lock(&g_map.lock);
+  for (map_t *m = g_map.head; m;) {
+    map_t *next = m->next;
+    if (m->h == h) map_destroy(m);
+    m = next;
+  }
+  pthread_mutex_unlock(&g_map.lock);
+}
+
+/* Whether [buf, buf + len) touches a mapping: as the buffer of a call that
+ * uses the cache, its faults would need the cache mid-call. */
+static int map_overlaps(const void *buf, size_t len) {
+  if (!__atomic_load_n(&g_map.n, __ATOMIC_ACQUIRE)) return 0;
+  uintptr_t lo = (uintptr_t)buf, hi = lo + len;
+  int hit = 0;
+  pthread_mutex_lock(&g_map.lock);
+  for (map_t *m = g_map.head; m && !hit; m = m->next) {
+    hit = lo < (uintptr_t)m->addr + m->len && (uintptr_t)m->addr < hi;
+  }
+  pthread_mutex_unlock(&g_map.lock);
+  return hit;
+}
+
+#else
+
+static void map_sync(vtpc_handle_t *h, uint64_t lo, uint64_t hi, int drop) {
+  (void)h; (void)lo; (void)hi; (void)drop;
+}
+
+static void map_close(vtpc_handle_t *h) {
+  (void)h;
+}
+
+static int map_overlaps(const void *buf, size_t len) {
+  (void)buf; (void)len;
+  return 0;
 }
 
+#endif
 
 int vtpc_open(const char* path, int mode, int access) {
+  return vtpc_open_ex(path, mode, access, NULL);
+}
+
+int vtpc_open_ex(const char* path, int mode, int access, const vtpc_opts* opts) {
   vtpc_init_once();
   if (!path) { errno = EINVAL; return -1; }
 
+  vtpc_opts o;
+  if (resolve_opts(opts, &o) != 0) return -1;
+
   int slot = alloc_handle_slot();
   if (slot < 0) return -1;
 
   int flags = mode;
-  int direct = 1;
+  int direct = (o.io != VTPC_IO_BUFFERED);
 
-  int fd = open(path, flags | O_DIRECT, access);
+  int fd = open(path, flags | (direct ? O_DIRECT : 0), access);
   if (fd < 0) {
-    if (errno == EINVAL) {
+    if (errno == EINVAL && o.io == VTPC_IO_DEFAULT) {
       direct = 0;
       fd = open(path, flags, access);
     }
@@ -613,7 +4540,7 @@ int vtpc_open(const char* path, int mode, int access) {
 
   #ifdef __APPLE__
     /* macOS analog of O_DIRECT: avoid kernel buffer cache */
-    (void)fcntl(fd, F_NOCACHE, 1);
+    if (direct) (void)fcntl(fd, F_NOCACHE, 1);
   #endif
 
   struct stat st;
@@ -629,16 +4556,60 @@ int vtpc_open(const char* path, int mode, int access) {
   h->used = 1;
   h->os_fd = fd;
   h->flags = flags;
+  h->efd = -1;
   h->direct = direct;
   h->pos = 0;
   h->size = st.st_size;
-
-  if (cache_init(&h->cache, vtpc_page_size()) != 0) {
-    int e = errno;
-    close(fd);
-    memset(h, 0, sizeof(*h));
-    errno = e;
-    return -1;
+  h->dio_align = dio_alignment(fd, direct);
+
+  h->key_base = (uint64_t)slot << VTPC_TAG_SHIFT;
+
+  vtpc_cache_t *c = NULL;
+  if (o.pool) {
+    c = g_pools[o.pool];
+    o.block_size = c->page_size;
+    if (o.block_size < h->dio_align) {
+      close(fd);
+      memset(h, 0, sizeof(*h));
+      errno = EINVAL;
+      return -1;
+    }
+  } else {
+    if (o.block_size == 0) {
+      o.block_size = max_sz(g_cfg_block_size, h->dio_align);
+    } else if (o.block_size < h->dio_align) {
+      close(fd);
+      memset(h, 0, sizeof(*h));
+      errno = EINVAL;
+      return -1;
+    }
+    c = cache_create(&o);
+    if (!c) {
+      int e = errno;
+      close(fd);
+      memset(h, 0, sizeof(*h));
+      errno = e;
+      return -1;
+    }
+  }
+  c->refs++;
+  h->cache = c;
+  h->opts = o;
+  h->pf_depth = VTPC_PREFETCH_DEPTH;
+  h->cl = o.access;
+
+  if (o.prefetch == VTPC_PREFETCH_MARKOV) {
+    size_t slots = next_pow2((c->capacity >> c->page_shift) * VTPC_MARKOV_SLOTS_PER_BLOCK);
+    slots = min_sz(max_sz(slots, VTPC_MARKOV_MIN_SLOTS), VTPC_MARKOV_MAX_SLOTS);
+    h->mk = (markov_slot_t*)calloc(slots, sizeof(*h->mk));
+    if (!h->mk) {
+      cache_detach(h);
+      close(fd);
+      memset(h, 0, sizeof(*h));
+      errno = ENOMEM;
+      return -1;
+    }
+    h->mk_mask = slots - 1;
   }
 
   return slot;
@@ -648,13 +4619,21 @@ int vtpc_close(int fd) {
   vtpc_handle_t *h = get_handle(fd);
   if (!h) { errno = EBADF; return -1; }
 
+  fill_cancel(h, 0, ~0ULL);
+  aio_free(h);
+  if (h->maps) map_close(h);
+  if (h->efd >= 0) close(h->efd);
   int flush_rc = cache_flush_all(h);
   int flush_errno = errno;
 
   int rc = close(h->os_fd);
   int close_errno = errno;
 
-  cache_destroy(h);
+  cache_detach(h);
+  free(h->pf_span);
+  free(h->mk);
+  free(h->resv_unread);
+  ring_free(h);
   memset(h, 0, sizeof(*h));
 
   if (flush_rc != 0) { errno = flush_errno; return -1; }
@@ -679,7 +4658,7 @@ off_t vtpc_lseek(int fd, off_t offset, int whence) {
   }
 
   off_t np = base + offset;
-  if (np < 0) { errno = EINVAL; return (off_t)-1; }
+  if (np < 0 || !range_fits(h->cache, (uint64_t)np, 1)) { errno = EINVAL; return (off_t)-1; }
   h->pos = np;
   return np;
 }
@@ -692,101 +4671,429 @@ ssize_t vtpc_read(int fd, void* buf, size_t count) {
   if (count == 0) return 0;
 
   if ((h->flags & O_ACCMODE) == O_WRONLY) { errno = EBADF; return -1; }
+  if (map_overlaps(buf, count)) { errno = EFAULT; return -1; }
 
-  size_t ps = h->cache.page_size;
-  size_t total = 0;
+  ssize_t r = cache_read(h, buf, count, h->pos, (h->flags & O_NONBLOCK) != 0);
+  if (r > 0) h->pos += r;
+  return r;
+}
 
-  while (total < count) {
-    off_t cur = h->pos;
-    uint64_t page_no = (uint64_t)(cur / (off_t)ps);
-    size_t in_page = (size_t)(cur % (off_t)ps);
+ssize_t vtpc_write(int fd, const void* buf, size_t count) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (!buf && count > 0) { errno = EINVAL; return -1; }
 
-    size_t want = min_sz(count - total, ps - in_page);
+  if (count == 0) return 0;
 
-    page_entry_t *p = cache_get(h, page_no);
-    if (!p) {
-      if (total > 0) return (ssize_t)total;
-      return -1;
-    }
+  int acc = (h->flags & O_ACCMODE);
+  if (acc == O_RDONLY) { errno = EBADF; return -1; }
+  if (map_overlaps(buf, count)) { errno = EFAULT; return -1; }
 
-    if (in_page >= p->valid_len) {
-      /* EOF */
-      break;
-    }
+  if (h->flags & O_APPEND) h->pos = h->size;
+  ssize_t r = cache_write(h, buf, count, h->pos);
+  if (r > 0) h->pos += r;
+  return r;
+}
+
+int vtpc_fsync(int fd) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  return cache_flush_all(h);
+}
+
+int vtpc_set_block_size(int fd, size_t block_size) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (!is_pow2(block_size) || block_size < h->dio_align ||
+      block_size > VTPC_MAX_BLOCK_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (block_size == h->cache->page_size) return 0;
+  if (h->cache->pool) { errno = EINVAL; return -1; }
+  if (h->resv_len || h->maps) { errno = EBUSY; return -1; }
+  return cache_reinit(h, block_size);
+}
 
-    size_t avail = p->valid_len - in_page;
-    size_t take = min_sz(want, avail);
+int vtpc_set_extent_pages(int fd, size_t pages) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (pages != 0 && (!is_pow2(pages) || pages > VTPC_MAX_EXTENT_PAGES)) {
+    errno = EINVAL;
+    return -1;
+  }
+  h->opts.extent_pages = pages;
+  h->ra_pages = 0;
+  return 0;
+}
 
-    memcpy((uint8_t*)buf + total, (uint8_t*)p->data + in_page, take);
+int vtpc_pool_create(const vtpc_opts* opts) {
+  vtpc_init_once();
 
-    total += take;
-    h->pos += (off_t)take;
+  vtpc_opts o;
+  if (resolve_opts(opts, &o) != 0) return -1;
+  if (o.pool) { errno = EINVAL; return -1; }
+  if (o.block_size == 0) o.block_size = g_cfg_block_size;
+  if (o.block_size < VTPC_MIN_BLOCK_SIZE) { errno = EINVAL; return -1; }
+
+  int id = 1;
+  while (id < VTPC_MAX_POOLS && g_pools[id]) id++;
+  if (id == VTPC_MAX_POOLS) { errno = EMFILE; return -1; }
+
+  vtpc_cache_t *c = cache_create(&o);
+  if (!c) return -1;
+  c->pool = id;
+  g_pools[id] = c;
+  return id;
+}
 
-    if (take < want) {
-      break;
-    }
+int vtpc_pool_destroy(int pool) {
+  if (pool <= 0 || pool >= VTPC_MAX_POOLS || !g_pools[pool]) {
+    errno = EINVAL;
+    return -1;
   }
+  if (g_pools[pool]->refs) { errno = EBUSY; return -1; }
 
-  return (ssize_t)total;
+  cache_destroy(g_pools[pool]);
+  g_pools[pool] = NULL;
+  return 0;
 }
 
-ssize_t vtpc_write(int fd, const void* buf, size_t count) {
+int vtpc_advice(int fd, off_t offset, size_t len, unsigned long long next_access_time) {
   vtpc_handle_t *h = get_handle(fd);
   if (!h) { errno = EBADF; return -1; }
-  if (!buf && count > 0) { errno = EINVAL; return -1; }
+  if (offset < 0) { errno = EINVAL; return -1; }
+  if (len == 0) return 0;
 
-  if (count == 0) return 0;
-
-  int acc = (h->flags & O_ACCMODE);
-  if (acc == O_RDONLY) { errno = EBADF; return -1; }
+  vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)offset, len)) { errno = EINVAL; return -1; }
+  if (!c->pol->advise) return 0;
 
-  size_t ps = h->cache.page_size;
+  uint64_t first = h->key_base | ((uint64_t)offset >> c->page_shift);
+  uint64_t last = h->key_base | (((uint64_t)offset + len - 1) >> c->page_shift);
+  c->pol->advise(c, first, last - first + 1, next_access_time);
+  return 0;
+}
 
-  if (h->flags & O_APPEND) h->pos = h->size;
+int vtpc_fadvise(int fd, off_t offset, off_t len, int advice) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (offset < 0 || len < 0) { errno = EINVAL; return -1; }
+
+  vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)offset, (uint64_t)len)) { errno = EINVAL; return -1; }
+  uint64_t first = (uint64_t)offset >> c->page_shift;
+  uint64_t last = len ? ((uint64_t)offset + (uint64_t)len - 1) >> c->page_shift
+                      : VTPC_FILE_PAGE_MASK;
+
+  switch (advice) {
+  case POSIX_FADV_NORMAL:
+    h->opts.access = VTPC_ACCESS_UNKNOWN;
+    h->cl = VTPC_ACCESS_UNKNOWN;
+    h->cl_n = h->cl_seq = h->cl_write = h->cl_new = h->cl_reused = 0;
+    h->noreuse = 0;
+    return 0;
+  case POSIX_FADV_SEQUENTIAL:
+  case POSIX_FADV_RANDOM:
+    h->opts.access = (advice == POSIX_FADV_RANDOM) ? VTPC_ACCESS_RANDOM : VTPC_ACCESS_SEQUENTIAL;
+    h->cl = h->opts.access;
+    return 0;
+  case POSIX_FADV_NOREUSE:
+    h->noreuse = 1;
+    return 0;
+  case POSIX_FADV_WILLNEED:
+    return cache_willneed(h, first, last + 1);
+  case POSIX_FADV_DONTNEED:
+    return cache_dontneed(h, first, last);
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+}
 
-  size_t total = 0;
+int vtpc_pin(int fd, off_t offset, size_t len) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (offset < 0) { errno = EINVAL; return -1; }
+  if (len == 0) return 0;
 
-  while (total < count) {
-    off_t cur = h->pos;
-    uint64_t page_no = (uint64_t)(cur / (off_t)ps);
-    size_t in_page = (size_t)(cur % (off_t)ps);
+  vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)offset, len)) { errno = EINVAL; return -1; }
+  return cache_pin(h, (uint64_t)offset >> c->page_shift,
+                   ((uint64_t)offset + len - 1) >> c->page_shift);
+}
 
-    size_t chunk = min_sz(count - total, ps - in_page);
+int vtpc_unpin(int fd, off_t offset, size_t len) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (offset < 0) { errno = EINVAL; return -1; }
+  if (len == 0) return 0;
+
+  vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)offset, len)) { errno = EINVAL; return -1; }
+  uint64_t eof_pages = ((uint64_t)h->size + c->page_mask) >> c->page_shift;
+  uint64_t last = ((uint64_t)offset + len - 1) >> c->page_shift;
+  if (eof_pages) cache_unpin(h, (uint64_t)offset >> c->page_shift, min_sz(last, eof_pages - 1));
+  return 0;
+}
 
-    page_entry_t *p = cache_get(h, page_no);
+int vtpc_mincore(int fd, off_t offset, size_t len, unsigned char *vec) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (offset < 0 || (!vec && len > 0)) { errno = EINVAL; return -1; }
+  if (len == 0) return 0;
+
+  const vtpc_cache_t *c = h->cache;
+  if (!range_fits(c, (uint64_t)offset, len)) { errno = EINVAL; return -1; }
+  if (h->maps) map_sync(h, (uint64_t)offset, (uint64_t)offset + len, 0);
+
+  /* one lookup per extent: its pages are filled in from the entry */
+  uint64_t first = (uint64_t)offset >> c->page_shift;
+  uint64_t last = ((uint64_t)offset + len - 1) >> c->page_shift;
+  for (uint64_t q = first; q <= last;) {
+    const page_entry_t *p = (const page_entry_t*)ht_get(&c->resident, h->key_base | q);
     if (!p) {
-      if (total > 0) return (ssize_t)total;
-      return -1;
+      vec[q++ - first] = 0;
+      continue;
+    }
+    uint64_t f = p->page_no & VTPC_FILE_PAGE_MASK;
+    uint64_t end = min_sz(f + p->npages, last + 1);
+    for (; q < end; q++) {
+      unsigned char v = VTPC_MINCORE_RESIDENT;
+      if (p->dirty & ((uint64_t)1 << (q - f))) v |= VTPC_MINCORE_DIRTY;
+      if (p->pins) v |= VTPC_MINCORE_PINNED;
+      vec[q - first] = v;
+    }
+  }
+  return 0;
+}
+
+int vtpc_eventfd(int fd) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+#ifdef __linux__
+  pthread_mutex_lock(&g_fill.lock);
+  if (h->efd < 0) h->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int efd = h->efd;
+  pthread_mutex_unlock(&g_fill.lock);
+  return efd;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int vtpc_submit(int fd, const vtpc_iocb *iocbs, int n) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (n < 0 || (!iocbs && n > 0)) { errno = EINVAL; return -1; }
+  if (aio_reserve(h, (size_t)n) != 0) return -1;
+
+  int acc = (h->flags & O_ACCMODE);
+  size_t before = h->nevents;
+  int i = 0;
+  for (; i < n; i++) {
+    const vtpc_iocb *io = &iocbs[i];
+    if (io->opcode == VTPC_OP_FSYNC) {
+      aio_complete(h, io->tag, cache_flush_all(h) == 0 ? 0 : -errno);
+      continue;
+    }
+    if ((io->opcode != VTPC_OP_READ && io->opcode != VTPC_OP_WRITE) || io->offset < 0 ||
+        (!io->buf && io->len > 0)) {
+      aio_complete(h, io->tag, -EINVAL);
+      continue;
+    }
+    if (map_overlaps(io->buf, io->len)) {
+      aio_complete(h, io->tag, -EFAULT);
+      continue;
+    }
+    if (io->opcode == VTPC_OP_WRITE) {
+      if (acc == O_RDONLY) {
+        aio_complete(h, io->tag, -EBADF);
+      } else if (io->len == 0) {
+        aio_complete(h, io->tag, 0);
+      } else {
+        ssize_t r = cache_write(h, io->buf, io->len, io->offset);
+        aio_complete(h, io->tag, r >= 0 ? r : -errno);
+      }
+      continue;
+    }
+    if (acc == O_WRONLY) {
+      aio_complete(h, io->tag, -EBADF);
+      continue;
     }
 
-    if (in_page > p->valid_len) {
-      memset((uint8_t*)p->data + p->valid_len, 0, in_page - p->valid_len);
+    aio_req_t *r = (aio_req_t*)calloc(1, sizeof(*r));
+    if (!r) break;
+    r->buf = io->buf;
+    r->len = io->len;
+    r->off = io->offset;
+    r->tag = io->tag;
+    if (aio_step(h, r, 1)) {
+      free(r);
+      continue;
     }
+    if (h->aio_tail) h->aio_tail->next = r; else h->aio = r;
+    h->aio_tail = r;
+    h->aio_n++;
+  }
+
+  if (h->nevents > before) aio_signal(h);
+  if (i == 0 && n > 0) { errno = ENOMEM; return -1; }
+  return i;
+}
 
-    memcpy((uint8_t*)p->data + in_page, (const uint8_t*)buf + total, chunk);
+int vtpc_reap(int fd, vtpc_event *events, int min, int max) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (min < 0 || max < min || (!events && max > 0)) { errno = EINVAL; return -1; }
+
+  aio_poll(h);
+  /* wait on the oldest read in flight, reading inline what is still queued */
+  while (h->nevents < (size_t)min && h->aio) {
+    aio_req_t *r = h->aio;
+    h->aio = r->next;
+    if (!h->aio) h->aio_tail = NULL;
+    h->aio_n--;
+    (void)aio_step(h, r, 0);
+    free(r);
+  }
 
-    p->valid_len = max_sz(p->valid_len, in_page + chunk);
-    p->dirty = 1;
+  size_t k = min_sz(h->nevents, (size_t)max);
+  if (k == 0) return 0;
+  memcpy(events, h->events, k * sizeof(*events));
+  memmove(h->events, h->events + k, (h->nevents - k) * sizeof(*events));
+  h->nevents -= k;
+  return (int)k;
+}
 
-    total += chunk;
-    h->pos += (off_t)chunk;
+int vtpc_write_reserve(int fd, off_t offset, size_t len, struct iovec *iov, int iovcnt) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (offset < 0 || len == 0 || !iov || iovcnt <= 0) { errno = EINVAL; return -1; }
+  if ((h->flags & O_ACCMODE) == O_RDONLY) { errno = EBADF; return -1; }
+  if (h->resv_len) { errno = EBUSY; return -1; }
+  return cache_reserve(h, offset, len, iov, iovcnt);
+}
 
-    off_t new_end = h->pos;
-    if (new_end > h->size) {
-      h->size = new_end;
-      
-      if (ftruncate(h->os_fd, h->size) != 0) {
-        if (total > 0) return (ssize_t)total;
-        return -1;
-      }
+int vtpc_write_commit(int fd, off_t offset, size_t len) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (!h->resv_len) { errno = EINVAL; return -1; }
+  if (len && (offset < h->resv_off ||
+              (uint64_t)offset + len > (uint64_t)h->resv_off + h->resv_len)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return cache_commit(h, offset, len);
+}
+
+int vtpc_read_batch(int fd, const vtpc_req *reqs, size_t n, ssize_t *res) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if ((!reqs || !res) && n > 0) { errno = EINVAL; return -1; }
+  if ((h->flags & O_ACCMODE) == O_WRONLY) { errno = EBADF; return -1; }
+
+  /* a non-blocking handle reads nothing here: misses go to the background */
+  int nowait = (h->flags & O_NONBLOCK) != 0;
+  batch_t b;
+  memset(&b, 0, sizeof(b));
+  if (!nowait) batch_prepare(h, reqs, n, &b);
+
+  h->batch = &b;
+  for (size_t i = 0; i < n; i++) {
+    const vtpc_req *r = &reqs[i];
+    if (r->offset < 0 || (!r->buf && r->len > 0)) {
+      res[i] = -EINVAL;
+    } else if (map_overlaps(r->buf, r->len)) {
+      res[i] = -EFAULT;
+    } else if (r->len == 0) {
+      res[i] = 0;
+    } else {
+      ssize_t got = cache_read(h, r->buf, r->len, r->offset, nowait);
+      res[i] = got >= 0 ? got : -errno;
     }
   }
+  h->batch = NULL;
+  batch_free(&b);
+  return 0;
+}
 
-  return (ssize_t)total;
+void* vtpc_mmap(int fd, off_t offset, size_t len) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return NULL; }
+  if (offset < 0 || len == 0) { errno = EINVAL; return NULL; }
+  if (!range_fits(h->cache, (uint64_t)offset, len)) { errno = EOVERFLOW; return NULL; }
+#ifdef __linux__
+  return map_create(h, (uint64_t)offset, len);
+#else
+  errno = ENOSYS;
+  return NULL;
+#endif
 }
 
-int vtpc_fsync(int fd) {
+int vtpc_munmap(void* addr, size_t len) {
+#ifdef __linux__
+  return map_remove(addr, len);
+#else
+  (void)addr;
+  (void)len;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int vtpc_scan(int fd, off_t offset, size_t len, vtpc_scan_fn cb, void* ctx, unsigned flags) {
   vtpc_handle_t *h = get_handle(fd);
   if (!h) { errno = EBADF; return -1; }
-  return cache_flush_all(h);
+  if (offset < 0 || !cb || (flags & ~VTPC_SCAN_TOUCH)) { errno = EINVAL; return -1; }
+  if ((h->flags & O_ACCMODE) == O_WRONLY) { errno = EBADF; return -1; }
+
+  if (offset >= h->size || len == 0) return 0;
+  uint64_t stop = (uint64_t)h->size;
+  if (len < stop - (uint64_t)offset) stop = (uint64_t)offset + len;
+  if (!range_fits(h->cache, (uint64_t)offset, stop - (uint64_t)offset)) {
+    errno = EOVERFLOW;
+    return -1;
+  }
+  if (h->maps) map_sync(h, (uint64_t)offset, stop, 0);
+  return cache_scan(h, (uint64_t)offset, stop, cb, ctx, flags);
+}
+
+int vtpc_get_stats(int fd, vtpc_stats* st) {
+  vtpc_handle_t *h = get_handle(fd);
+  if (!h) { errno = EBADF; return -1; }
+  if (!st) { errno = EINVAL; return -1; }
+
+  const vtpc_cache_t *c = h->cache;
+  memset(st, 0, sizeof(*st));
+  st->policy = c->pol->name;
+  st->block_size = c->page_size;
+  st->capacity = c->capacity;
+  st->resident_bytes = c->used;
+  st->pinned_bytes = c->pinned;
+  st->hits = c->hits;
+  st->misses = c->misses;
+  st->ghost_hits = c->ghost_hits;
+  st->evictions = c->evictions;
+  st->writebacks = c->writebacks;
+  st->admit_rejects = c->admit_rejects;
+  st->prefetches = h->prefetches;
+  st->prefetch_hits = h->prefetch_hits;
+  st->markov_prefetches = h->mk_prefetches;
+  st->markov_hits = h->mk_hits;
+  st->markov_coverage = (h->mk_hits + h->misses) ?
+      (double)h->mk_hits / (double)(h->mk_hits + h->misses) : 0.0;
+  st->markov_active = (h->mk && !h->mk_backoff);
+  st->access = h->cl;
+  st->bypass_admits = h->bypass_admits;
+  st->ring_fills = h->ring_fills;
+  st->async_fills = h->async_fills;
+  st->async_stale = h->async_stale;
+  st->nowait_misses = h->nowait_misses;
+  st->batch_reads = h->batch_reads;
+  st->map_faults = h->map_faults;
+  st->scan_reads = h->scan_reads;
+  if (c->pol->stats) c->pol->stats(c, st);
+  return 0;
 }
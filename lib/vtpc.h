@@ -1,18 +1,319 @@
 #pragma once
 
+#include <stddef.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Replacement policy; VTPC_POLICY_DEFAULT takes the VTPC_POLICY environment
+ * variable ("2q", "arc", "s3fifo", "lirs", "opt", "lruk", "gd"), falling
+ * back to 2Q when it is unset; opens that take an unknown name from it
+ * fail with EINVAL. "opt" evicts by the next-use times given to
+ * vtpc_advice; "gd" (GreedyDual) keeps blocks that are slow to read back or
+ * dirty longer. */
+typedef enum vtpc_policy {
+  VTPC_POLICY_DEFAULT = 0,
+  VTPC_POLICY_2Q,
+  VTPC_POLICY_ARC,
+  VTPC_POLICY_S3FIFO,
+  VTPC_POLICY_LIRS,
+  VTPC_POLICY_OPT,
+  VTPC_POLICY_LRUK,
+  VTPC_POLICY_GD,
+} vtpc_policy;
+
+typedef enum vtpc_io_backend {
+  VTPC_IO_DEFAULT = 0,   /* O_DIRECT, falling back to buffered I/O */
+  VTPC_IO_DIRECT,        /* O_DIRECT or fail with EINVAL */
+  VTPC_IO_BUFFERED,      /* OS page cache, dropped after every transfer */
+} vtpc_io_backend;
+
+/* Admission filter in front of the policy; VTPC_ADMIT_DEFAULT takes the
+ * VTPC_ADMISSION environment variable ("all", "tinylfu"), falling back to
+ * admitting every miss. With TinyLFU, missed extents wait in an LRU window
+ * of 1% of capacity and then enter the policy only if a frequency sketch
+ * rates them above the policy's next victim. */
+typedef enum vtpc_admission {
+  VTPC_ADMIT_DEFAULT = 0,
+  VTPC_ADMIT_ALL,
+  VTPC_ADMIT_TINYLFU,
+} vtpc_admission;
+
+/* Prefetcher; VTPC_PREFETCH_DEFAULT takes the VTPC_PREFETCH environment
+ * variable ("none", "stride", "markov"), falling back to stride. The stride
+ * prefetcher watches where each run of consecutive blocks starts and, once
+ * three runs start a constant distance apart (negative for backward scans),
+ * loads the next runs ahead of the reader. Prefetched blocks enter the cache
+ * cold, and the look-ahead shrinks when they are evicted unread.
+ * "markov" adds a table of which runs followed which, sized from the cache
+ * and kept per handle; a miss loads the successors seen at least twice,
+ * chained a few runs deep. It switches itself off for a while when fewer
+ * than a quarter of those prefetches get read. */
+typedef enum vtpc_prefetch {
+  VTPC_PREFETCH_DEFAULT = 0,
+  VTPC_PREFETCH_NONE,
+  VTPC_PREFETCH_STRIDE,
+  VTPC_PREFETCH_MARKOV,
+} vtpc_prefetch;
+
+/* Access pattern of a handle. VTPC_ACCESS_UNKNOWN in vtpc_opts has it
+ * classified online from every 64 block transitions; any other value
+ * declares it. A sequential reader streams blocks that are not resident
+ * through a small ring of extent buffers of its own, so a scan never
+ * enters the cache; its writes, and write-once data, bypass the policy:
+ * their blocks are the first to go and leave no ghosts, and a block read
+ * again joins the policy. Looping handles keep the first part of the loop
+ * (the most recently loaded of their blocks are evicted first), sequential
+ * and looping ones read ahead at full extent length right away, and strided
+ * and random ones never read ahead past the extent floor (strided ones leave
+ * it to the prefetcher). */
+typedef enum vtpc_access {
+  VTPC_ACCESS_UNKNOWN = 0,
+  VTPC_ACCESS_SEQUENTIAL,
+  VTPC_ACCESS_STRIDED,
+  VTPC_ACCESS_RANDOM,
+  VTPC_ACCESS_LOOPING,
+  VTPC_ACCESS_WRITE_ONCE,
+} vtpc_access;
+
+/* Per-handle configuration for vtpc_open_ex. Zero fields take the process
+ * defaults, so `vtpc_opts o = {0};` behaves like vtpc_open. */
+typedef struct vtpc_opts {
+  size_t capacity;        /* cache bytes; default VTPC_CACHE_PAGES blocks */
+  size_t block_size;      /* see vtpc_set_block_size */
+  vtpc_policy policy;
+  unsigned kin_pct;       /* 2Q A1in share of capacity, 1..90 */
+  unsigned kout_pct;      /* 2Q A1out ghosts, % of capacity, 1..400. With
+                             both 0, 2Q starts at 25/50 and tunes them */
+  unsigned lru_k;         /* LRU-K references kept, 1..4; default 2 */
+  unsigned lru_k_crp;     /* LRU-K: a re-reference within this many read/write
+                             calls is correlated; default 1 (same call) */
+  size_t extent_pages;    /* see vtpc_set_extent_pages */
+  size_t ra_min_pages;    /* first adaptive extent; default 1 */
+  size_t ra_max_pages;    /* adaptive extent ceiling, up to 64; default 64 */
+  vtpc_io_backend io;
+  vtpc_admission admission;
+  vtpc_prefetch prefetch;
+  vtpc_access access;
+  unsigned pin_pct;       /* share of capacity vtpc_pin may hold, 1..90; default 25 */
+  int pool;               /* vtpc_pool_create id to share; 0 = private cache */
+  unsigned long long cost_ns;  /* GreedyDual: cost of reading a block back, in ns;
+                                  default measured from the handle's reads */
+} vtpc_opts;
+
+/* A handle opened with O_NONBLOCK never waits for the file in vtpc_read:
+ * it returns the resident blocks at the front of the request, or -1 with
+ * errno EAGAIN when the first is not resident, and reads the rest of the
+ * request in the background. Such handles do not prefetch; vtpc_write
+ * still blocks.
+ *
+ * A file can be cached up to 2^48 blocks. Past that, writes (and
+ * vtpc_write_reserve) fail with EFBIG, reads, vtpc_mmap and vtpc_scan with
+ * EOVERFLOW, and vtpc_lseek and the other calls taking a range with
+ * EINVAL. */
 int vtpc_open(const char* path, int mode, int access);
+int vtpc_open_ex(const char* path, int mode, int access, const vtpc_opts* opts);
 int vtpc_close(int fd);
 ssize_t vtpc_read(int fd, void* buf, size_t count);
 ssize_t vtpc_write(int fd, const void* buf, size_t count);
 off_t vtpc_lseek(int fd, off_t offset, int whence);
 int vtpc_fsync(int fd);
 
+/* A pool is one cache shared by every handle opened with .pool = id: one
+ * capacity, block size, policy and admission filter, taken from opts here
+ * (the handles' own values for those are ignored). The block size cannot be
+ * changed per handle. Returns the id (> 0), or -1 with errno set. Destroying
+ * a pool fails with EBUSY while handles still use it. */
+int vtpc_pool_create(const vtpc_opts* opts);
+int vtpc_pool_destroy(int pool);
+
+/* Cache block size: a power of two between the direct-I/O alignment of the
+ * file and 8 MiB. The process default comes from VTPC_BLOCK_SIZE ("64k",
+ * "1M", ...). Changing it writes back and drops the handle's cache. */
+int vtpc_set_block_size(int fd, size_t block_size);
+
+/* Misses load extents of several contiguous blocks. pages is a power of two
+ * up to 64 for fixed, aligned extents, or 0 to size them adaptively: one
+ * block for random access, doubling while misses stay sequential. The
+ * process default comes from VTPC_EXTENT_PAGES (default 0). */
+int vtpc_set_extent_pages(int fd, size_t pages);
+
+/* Announce that [offset, offset + len) will next be read at
+ * next_access_time, in any unit that grows with time; ~0ULL means never.
+ * The hint covers that one access. Policies other than "opt" ignore it. */
+int vtpc_advice(int fd, off_t offset, size_t len, unsigned long long next_access_time);
+
+/* Keep the blocks of [offset, offset + len) below EOF resident, loading the
+ * missing ones, until as many vtpc_unpin calls cover them. Pins hold whole
+ * extents, outside the replacement policy; dirty ones are still written
+ * back by vtpc_fsync. A cache keeps at most pin_pct of its capacity pinned:
+ * past that vtpc_pin fails with ENOMEM and pins nothing. Pins end with the
+ * handle or a change of its block size. */
+int vtpc_pin(int fd, off_t offset, size_t len);
+int vtpc_unpin(int fd, off_t offset, size_t len);
+
+/* Which blocks of [offset, offset + len) the cache holds: one byte per
+ * block, from the block at offset to the one at offset + len - 1, of
+ * VTPC_MINCORE_* bits. Reads the resident index only: no replacement
+ * state, statistics or I/O change. */
+#define VTPC_MINCORE_RESIDENT 0x1
+#define VTPC_MINCORE_DIRTY    0x2   /* not written back yet */
+#define VTPC_MINCORE_PINNED   0x4
+int vtpc_mincore(int fd, off_t offset, size_t len, unsigned char *vec);
+
+/* posix_fadvise for the vtpc cache; advice is a POSIX_FADV_* constant from
+ * <fcntl.h> and len 0 means to the end of the file. Returns 0, or -1 with
+ * errno set.
+ *   WILLNEED    read the blocks of the range that are not resident in the
+ *               background, up to half the cache per call; they enter the
+ *               cache, cold, at the handle's next lookup
+ *   DONTNEED    write back and drop the handle's unpinned blocks in the range
+ *   SEQUENTIAL  declare the handle sequential (see vtpc_access)
+ *   RANDOM      declare it random: no readahead
+ *   NOREUSE     the handle's misses enter as the first eviction candidates
+ *   NORMAL      undo all of that and classify the handle online again
+ * The range is ignored but for WILLNEED and DONTNEED. */
+int vtpc_fadvise(int fd, off_t offset, off_t len, int advice);
+
+/* An eventfd that counts the handle's background reads as they finish: when
+ * it turns readable, read it to reset it and retry what failed with EAGAIN.
+ * Created on first call, non-blocking, closed by vtpc_close. Linux only:
+ * ENOSYS elsewhere. */
+int vtpc_eventfd(int fd);
+
+/* Asynchronous requests on one handle. vtpc_submit runs hits, writes and
+ * fsyncs at once and starts background reads for the blocks a read lacks;
+ * it returns how many requests it took (fewer than n only when out of
+ * memory), or -1 with errno set. vtpc_reap collects completions: it
+ * finishes the reads whose blocks have arrived, waits until at least min
+ * completions are ready or no read is left in flight, and returns up to
+ * max of them. Reads and writes use offset, not the file position, and
+ * requests in flight together may complete in any order. vtpc_eventfd
+ * turns readable when there may be completions to reap. */
+typedef enum vtpc_opcode {
+  VTPC_OP_READ = 0,
+  VTPC_OP_WRITE,
+  VTPC_OP_FSYNC,
+} vtpc_opcode;
+
+typedef struct vtpc_iocb {
+  vtpc_opcode opcode;
+  void* buf;
+  size_t len;
+  off_t offset;
+  unsigned long long tag;   /* returned with the completion */
+} vtpc_iocb;
+
+typedef struct vtpc_event {
+  unsigned long long tag;
+  ssize_t res;              /* bytes transferred (0 for fsync), or -errno */
+} vtpc_event;
+
+int vtpc_submit(int fd, const vtpc_iocb* iocbs, int n);
+int vtpc_reap(int fd, vtpc_event* events, int min, int max);
+
+/* Read n requests at their offsets, as n calls to pread would, into
+ * res[i]: bytes read, or -errno. Every block is looked up first; the
+ * missing ones are then read in file order, nearby ones together in a
+ * single read, before the requests are served in order. Returns 0, or -1
+ * with errno set for a bad handle or arguments. */
+typedef struct vtpc_req {
+  void* buf;
+  size_t len;
+  off_t offset;
+} vtpc_req;
+
+int vtpc_read_batch(int fd, const vtpc_req* reqs, size_t n, ssize_t* res);
+
+/* Write in place. vtpc_write_reserve pins the blocks under [offset,
+ * offset + len) and points iov at the range's bytes in them, one segment
+ * per extent; it returns the number of segments, up to iovcnt and perhaps
+ * covering only the start of the range, or -1 with errno set. Blocks that
+ * the range covers whole, or that lie past EOF, come zeroed instead of
+ * read. Fill the segments, then vtpc_write_commit what was written, within
+ * the reservation: it becomes dirty, the file grows to hold it, and the
+ * reservation ends; len 0 cancels it. The rest of the reservation keeps
+ * the file's contents, provided nothing outside the committed range was
+ * written to it. A handle holds one reservation at a time (EBUSY), within
+ * the pin budget (ENOMEM); until it is committed, reads of the range may
+ * see zeros. */
+int vtpc_write_reserve(int fd, off_t offset, size_t len, struct iovec* iov, int iovcnt);
+int vtpc_write_commit(int fd, off_t offset, size_t len);
+
+/* Hand [offset, offset + len) of the file, up to EOF, to cb in order, as
+ * spans that point into the cache or into buffers read ahead of cb in the
+ * background, without copying. A span is valid during its call only, and
+ * cb must not use the handle or another of its pool meanwhile. Returns 0
+ * once the range is done, cb's value as soon as it returns anything but
+ * 0, or -1 with errno set. The scan leaves the cache as it was: blocks it
+ * reads are not kept, and blocks it finds resident keep their place
+ * unless flags has VTPC_SCAN_TOUCH, which counts them as read. */
+typedef int (*vtpc_scan_fn)(const void* data, size_t len, off_t offset, void* ctx);
+
+#define VTPC_SCAN_TOUCH 0x1
+
+int vtpc_scan(int fd, off_t offset, size_t len, vtpc_scan_fn cb, void* ctx, unsigned flags);
+
+/* Map [offset, offset + len) of the file into memory served by the cache,
+ * not by the OS page cache; offset must be a multiple of the system page
+ * size, and so must the handle's block size be at least that. Pages come
+ * in from the cache when first touched, and go when their block is
+ * evicted; what is written to them reaches the cache at that eviction, at
+ * vtpc_fsync, vtpc_munmap or vtpc_close, and before a read, vtpc_scan or
+ * vtpc_mincore of the range. A vtpc_write over a mapped range drops the
+ * mapped copy first. Stores past EOF are not kept: the
+ * mapping never grows the file. A page whose block cannot be read raises
+ * SIGBUS when touched (on kernels before 6.6 the access waits instead,
+ * while the read is retried). Touching the mapping counts as using the
+ * handle: the mapping, the handle and every other handle of its pool must
+ * be used from one thread at a time, as faults are served from the cache
+ * without locking it. Its memory cannot be the buffer of another vtpc call
+ * (EFAULT). Returns NULL with errno set on failure. Needs userfaultfd:
+ * Linux only, ENOSYS elsewhere. */
+void* vtpc_mmap(int fd, off_t offset, size_t len);
+/* Write what the mapping starting at addr holds back into the cache and
+ * unmap it; len as given to vtpc_mmap. */
+int vtpc_munmap(void* addr, size_t len);
+
+typedef struct vtpc_stats {
+  const char* policy;
+  size_t block_size;
+  size_t capacity;          /* bytes */
+  size_t resident_bytes;
+  size_t pinned_bytes;      /* of those, held by vtpc_pin */
+  unsigned long long hits;        /* block lookups served from memory */
+  unsigned long long misses;
+  unsigned long long ghost_hits;  /* misses the policy still remembered */
+  unsigned long long evictions;
+  unsigned long long writebacks;
+  unsigned long long admit_rejects; /* TinyLFU: window entries turned away */
+  unsigned long long prefetches;    /* extents loaded ahead of a reader */
+  unsigned long long prefetch_hits; /* ... and read before being evicted */
+  unsigned long long markov_prefetches; /* of those, from the successor table */
+  unsigned long long markov_hits;
+  double markov_coverage;   /* markov_hits / (markov_hits + handle misses) */
+  int markov_active;        /* 0 when off or switched off for low accuracy */
+
+  vtpc_access access;       /* this handle's current class */
+  unsigned long long bypass_admits; /* extents it loaded outside the policy */
+  unsigned long long ring_fills;    /* extents it streamed past the cache */
+  unsigned long long async_fills;   /* WILLNEED reads installed */
+  unsigned long long async_stale;   /* ... dropped: the file changed under them */
+  unsigned long long nowait_misses; /* non-blocking reads cut short by a miss */
+  unsigned long long batch_reads;   /* disk reads vtpc_read_batch merged misses into */
+  unsigned long long map_faults;    /* pages vtpc_mmap mappings took from the cache */
+  unsigned long long scan_reads;    /* reads vtpc_scan issued ahead of its callback */
+
+  size_t arc_p;             /* ARC: adaptive T1 target, bytes */
+  size_t kin;               /* 2Q: current A1in target, bytes */
+  size_t kout;              /* 2Q: current A1out ghost budget, bytes */
+} vtpc_stats;
+
+int vtpc_get_stats(int fd, vtpc_stats* st);
+
 #ifdef __cplusplus
 }
 #endif
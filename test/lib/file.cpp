@@ -137,4 +137,25 @@ auto file::open_vtpc(std::string_view path) -> std::unique_ptr<file> {
   return std::make_unique<io_file>(path, std::move(io));
 }
 
+auto file::open_vtpc(std::string_view path, const vtpc_opts& opts)
+    -> std::unique_ptr<file> {
+  io io = {
+      .open = [opts](const char* path, int mode, int access
+              ) { return ::vtpc_open_ex(path, mode, access, &opts); },
+      .close = ::vtpc_close,
+      .read = ::vtpc_read,
+      .write = ::vtpc_write,
+      .lseek = ::vtpc_lseek,
+      .fsync = ::vtpc_fsync,
+  };
+
+  return std::make_unique<io_file>(path, std::move(io));
+}
+
+auto stats(int fd) -> vtpc_stats {
+  vtpc_stats st{};
+  vtpc_get_stats(fd, &st);
+  return st;
+}
+
 }  // namespace vt
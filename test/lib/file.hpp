@@ -9,6 +9,9 @@
 
 #include "exception.hpp"
 
+struct vtpc_opts;
+struct vtpc_stats;
+
 namespace vt {
 
 class file_exception : public vt::exception {
@@ -41,6 +44,11 @@ public:
 
   static auto open_libc(std::string_view path) -> std::unique_ptr<file>;
   static auto open_vtpc(std::string_view path) -> std::unique_ptr<file>;
+  static auto open_vtpc(std::string_view path, const vtpc_opts& opts)
+      -> std::unique_ptr<file>;
 };
 
+// vtpc_get_stats of a vtpc descriptor, zeroed if it fails.
+auto stats(int fd) -> vtpc_stats;
+
 }  // namespace vt
@@ -0,0 +1,179 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "exception.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 512;
+
+struct pattern {
+  std::string_view name;
+  vtpc_access expect;
+  std::function<void(int fd, std::string& buf)> run;
+};
+
+auto at(int fd, size_t b) -> void {
+  if (vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET) < 0) {
+    throw vt::exception() << "vtpc_lseek failed";
+  }
+}
+
+auto read_block(int fd, std::string& buf, size_t b) -> void {
+  at(fd, b);
+  if (vtpc_read(fd, buf.data(), block) != static_cast<ssize_t>(block)) {
+    throw vt::exception() << "vtpc_read failed at block " << b;
+  }
+}
+
+const std::vector<pattern> patterns = {
+    {"sequential", VTPC_ACCESS_SEQUENTIAL,
+     [](int fd, std::string& buf) {
+       for (size_t b = 0; b < blocks; ++b) read_block(fd, buf, b);
+     }},
+    {"strided", VTPC_ACCESS_STRIDED,
+     [](int fd, std::string& buf) {
+       for (size_t b = 0; b < blocks; b += 3) read_block(fd, buf, b);
+     }},
+    {"random", VTPC_ACCESS_RANDOM,
+     [](int fd, std::string& buf) {
+       std::default_random_engine random(1);  // NOLINT
+       std::uniform_int_distribution<size_t> dist(0, blocks - 1);
+       for (size_t i = 0; i < blocks; ++i) read_block(fd, buf, dist(random));
+     }},
+    {"looping", VTPC_ACCESS_LOOPING,
+     [](int fd, std::string& buf) {
+       for (size_t pass = 0; pass < 4; ++pass) {  // NOLINT
+         for (size_t b = 0; b < 100; ++b) read_block(fd, buf, b);  // NOLINT
+       }
+     }},
+    {"write-once", VTPC_ACCESS_WRITE_ONCE,
+     [](int fd, std::string& buf) {
+       at(fd, blocks);
+       for (size_t i = 0; i < 4 * blocks; ++i) {
+         if (vtpc_write(fd, buf.data(), 1000) != 1000) {  // NOLINT
+           throw vt::exception() << "vtpc_write failed";
+         }
+       }
+     }},
+};
+
+// A declared stream reads through its ring, past the cache, and still sees
+// every write made through the handle, before and after the ring held it.
+auto check_stream() -> void {
+  vtpc_opts opts{};
+  opts.capacity = 64 * block;  // NOLINT
+  opts.block_size = block;
+  opts.access = VTPC_ACCESS_SEQUENTIAL;
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  std::string file(blocks * block, '\0');
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block) % 26);  // NOLINT
+  }
+  if (vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+    throw vt::exception() << "vtpc_write failed";
+  }
+  vtpc_close(fd);
+
+  const int rd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  std::string buf(block, 'x');
+  for (size_t pass = 0; pass < 2; ++pass) {
+    for (size_t b = 0; b < blocks; ++b) {
+      // overwrite a block the ring read a moment ago and one it reads next,
+      // refill the ring over them, then push both out of the cache
+      if (b % 50 == 10) {  // NOLINT
+        for (const size_t w : {b - 1, b + 1}) {
+          file.replace(w * block, 100, 100, static_cast<char>('0' + pass));  // NOLINT
+          at(rd, w);
+          if (vtpc_write(rd, file.data() + w * block, 100) != 100) {  // NOLINT
+            throw vt::exception() << "vtpc_write failed";
+          }
+        }
+        read_block(rd, buf, b);
+        const size_t tail = blocks - 80;  // NOLINT
+        at(rd, tail);
+        if (vtpc_write(rd, file.data() + tail * block, 80 * block) !=  // NOLINT
+            static_cast<ssize_t>(80 * block)) {                     // NOLINT
+          throw vt::exception() << "vtpc_write failed";
+        }
+        read_block(rd, buf, b - 1);
+        if (buf != file.substr((b - 1) * block, block)) {
+          throw vt::exception() << "stream read stale data at block " << b - 1;
+        }
+      }
+      read_block(rd, buf, b);
+      if (buf != file.substr(b * block, block)) {
+        throw vt::exception() << "stream read wrong data at block " << b;
+      }
+    }
+  }
+
+  vtpc_stats st{};
+  vtpc_get_stats(rd, &st);
+  vtpc_close(rd);
+  if (st.ring_fills == 0) {
+    throw vt::exception() << "stream never used its ring";
+  }
+  std::filesystem::remove("/tmp/b");
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  const std::string zeros(blocks * block, '\0');
+
+  for (const pattern& p : patterns) {
+    vtpc_opts opts{};
+    opts.capacity = 64 * block;  // NOLINT
+    opts.block_size = block;
+    const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+    if (fd < 0) {
+      throw vt::exception() << "vtpc_open_ex failed";
+    }
+    if (vtpc_write(fd, zeros.data(), zeros.size()) != static_cast<ssize_t>(zeros.size())) {
+      throw vt::exception() << "vtpc_write failed";
+    }
+
+    // a fresh handle, so the setup writes do not count
+    const int rd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+    vtpc_close(fd);
+    std::string buf(block, 'x');
+    p.run(rd, buf);
+
+    vtpc_stats st{};
+    vtpc_get_stats(rd, &st);
+    vtpc_close(rd);
+    if (st.access != p.expect) {
+      throw vt::exception() << p.name << " classified as " << static_cast<int>(st.access);
+    }
+    if (p.expect == VTPC_ACCESS_SEQUENTIAL && st.ring_fills == 0) {
+      throw vt::exception() << p.name << " never used its ring";
+    }
+    std::filesystem::remove("/tmp/b");
+  }
+
+  check_stream();
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
@@ -0,0 +1,158 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 256;
+constexpr size_t inflight = 32;
+
+auto submit(int fd, std::vector<vtpc_iocb>& iocbs) -> void {
+  if (vtpc_submit(fd, iocbs.data(), static_cast<int>(iocbs.size())) !=
+      static_cast<int>(iocbs.size())) {
+    throw vt::exception() << "vtpc_submit failed";
+  }
+}
+
+auto reap(int fd, std::map<unsigned long long, ssize_t>& done, int min) -> void {
+  std::vector<vtpc_event> events(inflight + 8);  // NOLINT
+  const int n = vtpc_reap(fd, events.data(), min, static_cast<int>(events.size()));
+  if (n < min) {
+    throw vt::exception() << "vtpc_reap returned " << n;
+  }
+  for (int i = 0; i < n; ++i) {
+    done[events[i].tag] = events[i].res;
+  }
+}
+
+auto read_iocb(std::string& buf, size_t b, unsigned long long tag) -> vtpc_iocb {
+  return {.opcode = VTPC_OP_READ,
+          .buf = buf.data(),
+          .len = buf.size(),
+          .offset = static_cast<off_t>(b * block),
+          .tag = tag};
+}
+
+// An iocb that carries no buffer, such as an fsync.
+auto op_iocb(vtpc_opcode opcode, unsigned long long tag) -> vtpc_iocb {
+  vtpc_iocb iocb{};
+  iocb.opcode = opcode;
+  iocb.tag = tag;
+  return iocb;
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block, '\0');
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  vtpc_opts opts{};
+  opts.capacity = 128 * block;
+  opts.block_size = block;
+  opts.extent_pages = 1;
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+    throw vt::exception() << "setup failed";
+  }
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  const int efd = vtpc_eventfd(fd);
+
+  // cold reads go to the background; a hit, a write and an fsync do not
+  std::default_random_engine random(1);  // NOLINT
+  std::uniform_int_distribution<size_t> cold(8, blocks - 1);  // NOLINT
+  std::vector<std::string> bufs(inflight + 1, std::string(block, 'x'));
+  std::vector<size_t> where(inflight + 1);
+  std::vector<vtpc_iocb> iocbs;
+  for (size_t i = 0; i < inflight; ++i) {
+    where[i] = cold(random);
+    iocbs.push_back(read_iocb(bufs[i], where[i], i));
+  }
+  std::string fresh(block, 'w');
+  iocbs.push_back({.opcode = VTPC_OP_WRITE, .buf = fresh.data(), .len = block, .offset = 0,
+                   .tag = 100});  // NOLINT
+  iocbs.push_back(op_iocb(VTPC_OP_FSYNC, 101));  // NOLINT
+  where[inflight] = 0;
+  iocbs.push_back(read_iocb(bufs[inflight], 0, inflight));
+  iocbs.push_back(op_iocb(static_cast<vtpc_opcode>(7), 102));  // NOLINT
+  std::string past(block, 'x');
+  iocbs.push_back(read_iocb(past, blocks, 103));  // NOLINT
+  file.replace(0, block, fresh);
+  submit(fd, iocbs);
+
+  // a cold read may already have arrived, but the others must not wait
+  std::map<unsigned long long, ssize_t> done;
+  reap(fd, done, 0);
+  size_t arrived = 0;
+  for (size_t i = 0; i < inflight; ++i) {
+    arrived += done.count(i);
+  }
+  if (done.size() != 5 + arrived || done[100] != block || done[101] != 0 ||  // NOLINT
+      done[inflight] != block || done[102] != -EINVAL || done[103] != 0) {  // NOLINT
+    throw vt::exception() << "submit completed " << done.size() - arrived << " requests";
+  }
+  const unsigned long long misses = vt::stats(fd).misses;  // the write's
+
+  // the rest arrive as the eventfd signals them
+  while (done.size() < iocbs.size()) {
+    pollfd pfd = {.fd = efd, .events = POLLIN, .revents = 0};
+    if (::poll(&pfd, 1, 10000) != 1) {  // NOLINT
+      throw vt::exception() << "no completion signalled";
+    }
+    std::uint64_t count = 0;
+    (void)::read(efd, &count, sizeof(count));
+    reap(fd, done, 0);
+  }
+  for (size_t i = 0; i <= inflight; ++i) {
+    if (done[i] != block || bufs[i] != file.substr(where[i] * block, block)) {
+      throw vt::exception() << "read " << i << ": " << done[i];
+    }
+  }
+  if (vt::stats(fd).misses != misses) {
+    throw vt::exception() << "a read waited for the file";
+  }
+
+  // reap waits for min completions
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  iocbs.clear();
+  done.clear();
+  for (size_t i = 0; i < 8; ++i) {  // NOLINT
+    iocbs.push_back(read_iocb(bufs[i], where[i], i));
+  }
+  submit(fd, iocbs);
+  reap(fd, done, 8);  // NOLINT
+  for (size_t i = 0; i < 8; ++i) {  // NOLINT
+    if (done[i] != block || bufs[i] != file.substr(where[i] * block, block)) {
+      throw vt::exception() << "waited read " << i << ": " << done[i];
+    }
+  }
+
+  vtpc_close(fd);
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
@@ -0,0 +1,145 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 1024;
+
+struct batch {
+  std::vector<std::string> bufs;
+  std::vector<vtpc_req> reqs;
+  std::vector<ssize_t> res;
+
+  auto add(off_t offset, size_t len) -> void {
+    bufs.emplace_back(len, 'x');
+    reqs.push_back({.buf = nullptr, .len = len, .offset = offset});
+  }
+
+  auto run(int fd) -> void {
+    for (size_t i = 0; i < reqs.size(); ++i) {
+      reqs[i].buf = bufs[i].data();
+    }
+    res.assign(reqs.size(), -1);
+    if (vtpc_read_batch(fd, reqs.data(), reqs.size(), res.data()) != 0) {
+      throw vt::exception() << "vtpc_read_batch failed";
+    }
+  }
+
+  // every request read what pread would have
+  auto check(const std::string& file) const -> void {
+    for (size_t i = 0; i < reqs.size(); ++i) {
+      const auto off = static_cast<size_t>(reqs[i].offset);
+      const size_t from = std::min(off, file.size());
+      const size_t want = std::min(reqs[i].len, file.size() - from);
+      if (res[i] != static_cast<ssize_t>(want) || bufs[i].substr(0, want) != file.substr(from, want)) {
+        throw vt::exception() << "request " << i << " at " << off << ": " << res[i];
+      }
+    }
+  }
+};
+
+auto open_file(size_t extent_pages) -> int {
+  vtpc_opts opts{};
+  opts.capacity = 256 * block;
+  opts.block_size = block;
+  opts.extent_pages = extent_pages;
+  const int fd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  return fd;
+}
+
+// Misses are read in file order, nearby ones together; a dirty block
+// between them still comes from the cache.
+auto check_merge(std::string& file) -> void {
+  const int fd = open_file(1);
+  file.replace(13 * block, 5, "dirty");  // NOLINT
+  vtpc_lseek(fd, 13 * block, SEEK_SET);  // NOLINT
+  vtpc_write(fd, "dirty", 5);            // NOLINT
+
+  batch b;
+  for (const size_t n : {14, 500, 10, 12, 11, 13}) {  // NOLINT
+    b.add(static_cast<off_t>(n * block), block);
+  }
+  b.add(300 * block + 100, block);  // NOLINT
+  b.add(blocks * block, block);
+  b.run(fd);
+  b.check(file);
+  if (vt::stats(fd).batch_reads != 3) {
+    throw vt::exception() << vt::stats(fd).batch_reads << " reads, expected 3";
+  }
+
+  batch bad;
+  bad.add(0, block);
+  bad.reqs.push_back({.buf = nullptr, .len = 1, .offset = -1});
+  bad.res.assign(2, 0);
+  bad.reqs[0].buf = bad.bufs[0].data();
+  vtpc_read_batch(fd, bad.reqs.data(), 2, bad.res.data());
+  if (bad.res[0] != static_cast<ssize_t>(block) || bad.res[1] != -EINVAL) {
+    throw vt::exception() << "bad request: " << bad.res[1];
+  }
+  vtpc_close(fd);
+}
+
+auto check_random(const std::string& file, size_t extent_pages) -> void {
+  const int fd = open_file(extent_pages);
+  std::default_random_engine random(extent_pages);
+  std::uniform_int_distribution<size_t> offset(0, file.size() + block);
+  std::uniform_int_distribution<size_t> len(1, 3 * block);  // NOLINT
+  for (int round = 0; round < 10; ++round) {  // NOLINT
+    batch b;
+    for (int i = 0; i < 200; ++i) {  // NOLINT
+      b.add(static_cast<off_t>(offset(random)), len(random));
+    }
+    b.run(fd);
+    b.check(file);
+  }
+  vtpc_close(fd);
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block - 100, '\0');  // NOLINT
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+
+  check_merge(file);
+  check_random(file, 1);
+  check_random(file, 8);  // NOLINT
+  check_random(file, 0);
+
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
@@ -0,0 +1,174 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t kib = 1024;
+
+auto slurp(const char* path) -> std::string {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+}
+
+// VTPC_BLOCK_SIZE sets the default, vtpc_set_block_size changes it for one
+// handle, and sizes that are not a power of two or not aligned are refused.
+auto check_sizes() -> void {
+  std::filesystem::remove("/tmp/b");
+  const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open failed";
+  }
+  if (vt::stats(fd).block_size != 64 * kib) {  // NOLINT
+    throw vt::exception() << "VTPC_BLOCK_SIZE ignored: " << vt::stats(fd).block_size;
+  }
+  vtpc_lseek(fd, 100000, SEEK_SET);         // NOLINT
+  if (vtpc_write(fd, "resized", 7) != 7) {  // NOLINT
+    throw vt::exception() << "vtpc_write failed";
+  }
+
+  if (vtpc_set_block_size(fd, 256 * kib) != 0 || vt::stats(fd).block_size != 256 * kib) {  // NOLINT
+    throw vt::exception() << "vtpc_set_block_size(256k) failed";
+  }
+  for (const size_t bad : {size_t{3000}, 3 * 64 * kib, size_t{256}, 16 * kib * kib}) {  // NOLINT
+    if (vtpc_set_block_size(fd, bad) == 0 || errno != EINVAL) {
+      throw vt::exception() << "block size " << bad << " accepted";
+    }
+  }
+  if (vt::stats(fd).block_size != 256 * kib) {  // NOLINT
+    throw vt::exception() << "a refused size changed the block size";
+  }
+
+  std::string buf(7, 'x');                // NOLINT
+  vtpc_lseek(fd, 100000, SEEK_SET);       // NOLINT
+  if (vtpc_read(fd, buf.data(), buf.size()) != 7 || buf != "resized") {  // NOLINT
+    throw vt::exception() << "data lost across the change: '" << buf << "'";
+  }
+  vtpc_close(fd);
+}
+
+// Unaligned reads and writes that straddle block boundaries, through a
+// cache of four blocks so that blocks are written back and read again,
+// checked against the same writes applied to a string.
+auto check_crossing(size_t block) -> void {
+  constexpr size_t blocks = 16;
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block, '.');
+  const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+  if (fd < 0 || vtpc_set_block_size(fd, block) != 0) {
+    throw vt::exception() << "vtpc_open failed";
+  }
+  if (vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+    throw vt::exception() << "vtpc_write failed";
+  }
+
+  std::default_random_engine random(block);  // NOLINT
+  std::uniform_int_distribution<size_t> before(1, 100);  // NOLINT
+  std::uniform_int_distribution<size_t> len(2, 2 * block);
+  for (size_t b = 1; b < blocks; ++b) {
+    const size_t off = b * block - before(random);
+    const std::string data(len(random), static_cast<char>('a' + b));
+    vtpc_lseek(fd, static_cast<off_t>(off), SEEK_SET);
+    if (vtpc_write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+      throw vt::exception() << "vtpc_write failed at " << off;
+    }
+    file.replace(off, data.size(), data);
+  }
+  std::string buf(block + 13, 'x');  // NOLINT
+  for (size_t b = 1; b < blocks; ++b) {
+    const size_t off = b * block - 7;  // NOLINT
+    const size_t n = std::min(buf.size(), file.size() - off);
+    vtpc_lseek(fd, static_cast<off_t>(off), SEEK_SET);
+    if (vtpc_read(fd, buf.data(), n) != static_cast<ssize_t>(n) ||
+        file.compare(off, n, buf, 0, n) != 0) {
+      throw vt::exception() << "wrong data read at " << off << " with " << block << "-byte blocks";
+    }
+  }
+  vtpc_close(fd);
+  if (slurp("/tmp/b") != file) {
+    throw vt::exception() << "file differs with " << block << "-byte blocks";
+  }
+}
+
+// A cache page number keeps 48 bits for the block, so with 4 KiB blocks
+// nothing past 2^60 bytes is cached: a range that crosses that is refused
+// before it reaches the cache, and the handle goes on working.
+auto check_limit() -> void {
+  constexpr off_t limit = off_t{1} << 60;  // NOLINT
+  std::filesystem::remove("/tmp/b");
+  vtpc_opts opts{};
+  opts.capacity = 4 * 4 * kib;  // NOLINT
+  opts.block_size = 4 * kib;    // NOLINT
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  const auto refused = [](bool failed, int err, const char* call) {
+    if (!failed || errno != err) {
+      throw vt::exception() << call << " past the last block was not refused";
+    }
+  };
+
+  std::string buf(16, 'x');  // NOLINT
+  unsigned char vec[2] = {};
+  iovec iov{};
+  refused(vtpc_lseek(fd, limit, SEEK_SET) < 0, EINVAL, "vtpc_lseek");
+  if (vtpc_lseek(fd, limit - 8, SEEK_SET) != limit - 8 ||  // NOLINT
+      vtpc_read(fd, buf.data(), buf.size()) != 0) {
+    throw vt::exception() << "the last block is out of reach";
+  }
+  refused(vtpc_write(fd, buf.data(), buf.size()) < 0, EFBIG, "vtpc_write");
+  refused(vtpc_write_reserve(fd, limit - 8, 16, &iov, 1) < 0, EFBIG, "vtpc_write_reserve");  // NOLINT
+  refused(vtpc_advice(fd, limit - 8, 16, 1) < 0, EINVAL, "vtpc_advice");  // NOLINT
+  refused(vtpc_fadvise(fd, limit - 8, 16, POSIX_FADV_WILLNEED) < 0, EINVAL, "vtpc_fadvise");  // NOLINT
+  refused(vtpc_pin(fd, limit - 8, 16) < 0, EINVAL, "vtpc_pin");  // NOLINT
+  refused(vtpc_mincore(fd, limit - 8, 16, vec) < 0, EINVAL, "vtpc_mincore");  // NOLINT
+  refused(vtpc_mmap(fd, limit - 4 * kib, 8 * kib) == nullptr, EOVERFLOW, "vtpc_mmap");  // NOLINT
+  if (vtpc_mincore(fd, limit - 4 * kib, 4 * kib, vec) != 0 || vec[0] != 0) {  // NOLINT
+    throw vt::exception() << "vtpc_mincore of the last block failed";
+  }
+
+  vtpc_lseek(fd, 0, SEEK_SET);
+  if (vtpc_write(fd, "kept", 4) != 4 || vtpc_lseek(fd, 0, SEEK_SET) != 0 ||  // NOLINT
+      vtpc_read(fd, buf.data(), 4) != 4 || buf.compare(0, 4, "kept") != 0) {  // NOLINT
+    throw vt::exception() << "the handle broke after the refused calls";
+  }
+  vtpc_close(fd);
+}
+
+}  // namespace
+
+auto main() -> int try {
+  // read once, at the first call into the library
+  setenv("VTPC_BLOCK_SIZE", "64k", 1);  // NOLINT
+  setenv("VTPC_CACHE_PAGES", "4", 1);   // NOLINT
+  check_sizes();
+  check_crossing(64 * kib);   // NOLINT
+  check_crossing(256 * kib);  // NOLINT
+  check_limit();
+
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
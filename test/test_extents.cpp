@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 512;
+constexpr size_t capacity = 64;  // blocks; extents of up to 8 of them
+
+auto disk() -> std::string {
+  std::string data(blocks * block, '\0');
+  const int os = ::open("/tmp/b", O_RDONLY);
+  const ssize_t got = ::pread(os, data.data(), data.size(), 0);
+  ::close(os);
+  if (got != static_cast<ssize_t>(data.size())) {
+    throw vt::exception() << "short read of the file";
+  }
+  return data;
+}
+
+auto check_resident(int fd) -> void {
+  const size_t resident = vt::stats(fd).resident_bytes;
+  if (resident > capacity * block) {
+    throw vt::exception() << resident << " bytes resident in a " << capacity << "-block cache";
+  }
+}
+
+// Single bytes written here and there inside extents of several blocks:
+// eviction writes back the dirty blocks and leaves the rest of the file be.
+auto run(size_t extent_pages) -> void {
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block, '\0');
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+
+  const std::string before = disk();
+  const int fd = vtpc_open("/tmp/b", O_RDWR, 0);
+  if (fd < 0 || vtpc_set_extent_pages(fd, extent_pages) != 0) {
+    throw vt::exception() << "vtpc_open failed";
+  }
+
+  // sequential reads grow adaptive extents; fixed ones are loaded whole
+  std::string buf(8 * block, 'x');  // NOLINT
+  vtpc_read(fd, buf.data(), buf.size());
+  vtpc_read(fd, buf.data(), buf.size());
+
+  std::default_random_engine random(extent_pages);  // NOLINT
+  std::uniform_int_distribution<size_t> offset(0, file.size() - 1);
+  for (size_t i = 0; i < 600; ++i) {  // NOLINT
+    const size_t off = (i % 3 == 0) ? offset(random) % (16 * block) : offset(random);  // NOLINT
+    const char c = static_cast<char>('A' + i % 26);                                    // NOLINT
+    vtpc_lseek(fd, static_cast<off_t>(off), SEEK_SET);
+    if (vtpc_write(fd, &c, 1) != 1) {
+      throw vt::exception() << "vtpc_write failed at " << off;
+    }
+    file[off] = c;
+    check_resident(fd);
+  }
+
+  // everything read back, through a cache an eighth of the file
+  vtpc_lseek(fd, 0, SEEK_SET);
+  std::string back(file.size(), 'x');
+  for (size_t done = 0; done < back.size(); done += 3 * block + 5) {  // NOLINT
+    const size_t n = std::min(3 * block + 5, back.size() - done);     // NOLINT
+    if (vtpc_read(fd, back.data() + done, n) != static_cast<ssize_t>(n)) {
+      throw vt::exception() << "vtpc_read failed at " << done;
+    }
+    check_resident(fd);
+  }
+  if (back != file) {
+    throw vt::exception() << "wrong data read back";
+  }
+  if (disk() == before || vt::stats(fd).evictions == 0) {
+    throw vt::exception() << "nothing was evicted";
+  }
+  vtpc_close(fd);
+  if (disk() != file) {
+    throw vt::exception() << "wrong file contents";
+  }
+}
+
+// A hot set read over and over, then a one-shot scan in block-sized reads:
+// reading on through an extent is one reference to it, so under 2Q the
+// scanned extents leave from A1in and the hot ones stay.
+auto check_scan(size_t extent_pages) -> void {
+  vtpc_opts opts{};
+  opts.capacity = capacity * block;
+  opts.block_size = block;
+  opts.extent_pages = extent_pages;
+  opts.policy = VTPC_POLICY_2Q;
+  opts.access = VTPC_ACCESS_RANDOM;
+  opts.prefetch = VTPC_PREFETCH_NONE;
+  const int fd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+
+  std::string buf(block, 'x');
+  const auto read_block = [&](size_t b) {
+    vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET);
+    if (vtpc_read(fd, buf.data(), block) != static_cast<ssize_t>(block)) {
+      throw vt::exception() << "vtpc_read failed at block " << b;
+    }
+  };
+  for (size_t pass = 0; pass < 8; ++pass) {  // NOLINT
+    for (size_t b = 0; b < 8; ++b) {         // NOLINT
+      read_block(b);
+    }
+  }
+  for (size_t b = 64; b < 264; ++b) {  // NOLINT
+    read_block(b);
+  }
+
+  std::vector<unsigned char> vec(8);  // NOLINT
+  vtpc_mincore(fd, 0, 8 * block, vec.data());  // NOLINT
+  for (size_t b = 0; b < vec.size(); ++b) {
+    if ((vec[b] & VTPC_MINCORE_RESIDENT) == 0) {
+      throw vt::exception() << "hot block " << b << " evicted by a scan over "
+                            << extent_pages << "-block extents";
+    }
+  }
+  vtpc_close(fd);
+}
+
+}  // namespace
+
+auto main() -> int try {
+  // read once, at the first call into the library
+  setenv("VTPC_BLOCK_SIZE", "4k", 1);                                // NOLINT
+  setenv("VTPC_CACHE_PAGES", std::to_string(capacity).c_str(), 1);  // NOLINT
+  for (const size_t extent_pages : {0, 4, 8}) {  // NOLINT
+    std::cerr << "extent pages: " << extent_pages << '\n';
+    run(extent_pages);
+  }
+  for (const size_t extent_pages : {1, 8}) {  // NOLINT
+    check_scan(extent_pages);
+  }
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
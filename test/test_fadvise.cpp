@@ -0,0 +1,159 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 256;
+
+auto contents() -> std::string {
+  std::string data(blocks * block, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  return data;
+}
+
+auto open_file() -> int {
+  vtpc_opts opts{};
+  opts.capacity = 128 * block;
+  opts.block_size = block;
+  const int fd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  return fd;
+}
+
+auto advise(int fd, size_t first, size_t n, int advice) -> void {
+  if (vtpc_fadvise(fd, static_cast<off_t>(first * block), static_cast<off_t>(n * block),
+                   advice) != 0) {
+    throw vt::exception() << "vtpc_fadvise(" << advice << ") failed";
+  }
+}
+
+auto check_blocks(int fd, const std::string& file, size_t first, size_t n) -> void {
+  std::string buf(block, 'x');
+  for (size_t b = first; b < first + n; ++b) {
+    vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET);
+    if (vtpc_read(fd, buf.data(), block) != static_cast<ssize_t>(block)) {
+      throw vt::exception() << "vtpc_read failed at block " << b;
+    }
+    if (buf != file.substr(b * block, block)) {
+      throw vt::exception() << "wrong data at block " << b;
+    }
+  }
+}
+
+// WILLNEED reads ahead in the background: the reads that follow never miss.
+auto check_willneed(const std::string& file) -> void {
+  const int fd = open_file();
+  advise(fd, 40, 48, POSIX_FADV_WILLNEED);  // NOLINT
+  check_blocks(fd, file, 40, 48);           // NOLINT
+  const vtpc_stats st = vt::stats(fd);
+  vtpc_close(fd);
+  if (st.misses != 0 || st.async_fills == 0 || st.prefetch_hits == 0) {
+    throw vt::exception() << "WILLNEED: " << st.misses << " misses, " << st.async_fills
+                          << " fills";
+  }
+}
+
+// Background reads never bring back data older than a write-back.
+auto check_writes(std::string& file) -> void {
+  const int fd = open_file();
+  for (const size_t b : {3, 9, 17}) {  // NOLINT
+    file.replace(b * block + 10, 5, "fresh");  // NOLINT
+    vtpc_lseek(fd, static_cast<off_t>(b * block + 10), SEEK_SET);
+    if (vtpc_write(fd, "fresh", 5) != 5) {  // NOLINT
+      throw vt::exception() << "vtpc_write failed";
+    }
+  }
+  advise(fd, 0, 32, POSIX_FADV_WILLNEED);  // NOLINT
+  advise(fd, 9, 1, POSIX_FADV_DONTNEED);   // NOLINT
+  check_blocks(fd, file, 0, 32);           // NOLINT
+  if (vt::stats(fd).async_stale == 0) {
+    throw vt::exception() << "fills read before a write-back were installed";
+  }
+
+  // DONTNEED wrote block 9 back and dropped it; the whole file goes next
+  advise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  if (vt::stats(fd).resident_bytes != 0) {
+    throw vt::exception() << "DONTNEED left blocks resident";
+  }
+  std::string disk(file.size(), '\0');
+  const int os = ::open("/tmp/b", O_RDONLY);
+  const ssize_t got = ::pread(os, disk.data(), disk.size(), 0);
+  ::close(os);
+  if (got != static_cast<ssize_t>(disk.size()) || disk != file) {
+    throw vt::exception() << "DONTNEED did not write back";
+  }
+  check_blocks(fd, file, 0, blocks);
+  vtpc_close(fd);
+}
+
+auto check_hints() -> void {
+  const int fd = open_file();
+  advise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (vt::stats(fd).access != VTPC_ACCESS_SEQUENTIAL) {
+    throw vt::exception() << "SEQUENTIAL not applied";
+  }
+  advise(fd, 0, 0, POSIX_FADV_RANDOM);
+  if (vt::stats(fd).access != VTPC_ACCESS_RANDOM) {
+    throw vt::exception() << "RANDOM not applied";
+  }
+  advise(fd, 0, 0, POSIX_FADV_NOREUSE);
+  std::string buf(block, 'x');
+  vtpc_lseek(fd, 0, SEEK_SET);
+  vtpc_read(fd, buf.data(), block);
+  if (vt::stats(fd).bypass_admits != 1) {
+    throw vt::exception() << "NOREUSE block entered the policy";
+  }
+  advise(fd, 0, 0, POSIX_FADV_NORMAL);
+  if (vt::stats(fd).access != VTPC_ACCESS_UNKNOWN) {
+    throw vt::exception() << "NORMAL not applied";
+  }
+  if (vtpc_fadvise(fd, 0, 0, -1) == 0 || errno != EINVAL ||
+      vtpc_fadvise(fd, -1, 0, POSIX_FADV_WILLNEED) == 0 || errno != EINVAL) {
+    throw vt::exception() << "bad advice accepted";
+  }
+  vtpc_close(fd);
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file = contents();
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+
+  check_willneed(file);
+  check_writes(file);
+  check_hints();
+
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
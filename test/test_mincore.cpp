@@ -0,0 +1,92 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 64;
+
+auto mincore(int fd) -> std::vector<unsigned char> {
+  std::vector<unsigned char> vec(blocks, 0xff);  // NOLINT
+  if (vtpc_mincore(fd, 0, blocks * block, vec.data()) != 0) {
+    throw vt::exception() << "vtpc_mincore failed";
+  }
+  return vec;
+}
+
+auto expect(const std::vector<unsigned char>& vec, size_t b, unsigned char bits) -> void {
+  if (vec[b] != bits) {
+    throw vt::exception() << "block " << b << ": " << static_cast<int>(vec[b]) << ", expected "
+                          << static_cast<int>(bits);
+  }
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  vtpc_opts opts{};
+  opts.capacity = 256 * block;
+  opts.block_size = block;
+  opts.extent_pages = 1;
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  const std::string data(blocks * block, 'a');
+  if (vtpc_write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+    throw vt::exception() << "vtpc_write failed";
+  }
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  std::string buf(block, 'x');
+  vtpc_lseek(fd, 3 * block, SEEK_SET);
+  vtpc_read(fd, buf.data(), block);
+  vtpc_lseek(fd, 5 * block + 7, SEEK_SET);  // NOLINT
+  vtpc_write(fd, "dirty", 5);               // NOLINT
+  vtpc_pin(fd, 9 * block, block);           // NOLINT
+
+  const vtpc_stats before = vt::stats(fd);
+  std::vector<unsigned char> vec = mincore(fd);
+  const vtpc_stats after = vt::stats(fd);
+  if (after.hits != before.hits || after.misses != before.misses) {
+    throw vt::exception() << "vtpc_mincore touched the cache";
+  }
+  expect(vec, 0, 0);
+  expect(vec, 3, VTPC_MINCORE_RESIDENT);
+  expect(vec, 5, VTPC_MINCORE_RESIDENT | VTPC_MINCORE_DIRTY);  // NOLINT
+  expect(vec, 9, VTPC_MINCORE_RESIDENT | VTPC_MINCORE_PINNED);  // NOLINT
+  expect(vec, blocks - 1, 0);
+
+  // the vector starts at the block holding offset
+  unsigned char one = 0xff;  // NOLINT
+  vtpc_mincore(fd, 5 * block + 100, 1, &one);  // NOLINT
+  if (one != (VTPC_MINCORE_RESIDENT | VTPC_MINCORE_DIRTY)) {
+    throw vt::exception() << "unaligned offset: " << static_cast<int>(one);
+  }
+
+  vtpc_fsync(fd);
+  vec = mincore(fd);
+  expect(vec, 5, VTPC_MINCORE_RESIDENT);  // NOLINT
+
+  vtpc_close(fd);
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
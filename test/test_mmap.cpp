@@ -0,0 +1,175 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 64;
+
+auto contents() -> std::string {
+  std::string data(blocks * block, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  return data;
+}
+
+auto disk() -> std::string {
+  std::string data(blocks * block, '\0');
+  const int os = ::open("/tmp/b", O_RDONLY);
+  const ssize_t got = ::pread(os, data.data(), data.size(), 0);
+  ::close(os);
+  if (got != static_cast<ssize_t>(data.size())) {
+    throw vt::exception() << "short read of the file";
+  }
+  return data;
+}
+
+auto check(const char* map, const std::string& file) -> void {
+  for (size_t b = 0; b < blocks; ++b) {
+    if (std::memcmp(map + b * block, file.data() + b * block, block) != 0) {
+      throw vt::exception() << "wrong data at block " << b;
+    }
+  }
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file = contents();
+  vtpc_opts opts{};
+  opts.capacity = 16 * block;
+  opts.block_size = block;
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+    throw vt::exception() << "setup failed";
+  }
+  vtpc_fsync(fd);
+
+  char* map = static_cast<char*>(vtpc_mmap(fd, 0, file.size()));
+  if (!map) {
+    // userfaultfd may be missing or forbidden here
+    std::cerr << "vtpc_mmap: " << std::strerror(errno) << ", skipped\n";
+    vtpc_close(fd);
+    std::filesystem::remove("/tmp/b");
+    return 0;
+  }
+
+  // four times the cache, twice over: blocks come and go
+  check(map, file);
+  check(map, file);
+  vtpc_stats st = vt::stats(fd);
+  if (st.map_faults <= blocks || st.resident_bytes > 16 * block) {  // NOLINT
+    throw vt::exception() << st.map_faults << " faults, " << st.resident_bytes << " bytes resident";
+  }
+
+  // stores reach the file at fsync, and at eviction
+  std::memcpy(map + 3 * block + 5, "fsync", 5);  // NOLINT
+  file.replace(3 * block + 5, 5, "fsync");       // NOLINT
+  if (vtpc_fsync(fd) != 0 || disk() != file) {
+    throw vt::exception() << "fsync missed a store";
+  }
+  std::memcpy(map + 3 * block + 5, "again", 5);  // NOLINT
+  file.replace(3 * block + 5, 5, "again");       // NOLINT
+  std::memcpy(map + 40 * block, "evict", 5);     // NOLINT
+  file.replace(40 * block, 5, "evict");          // NOLINT
+  check(map, file);
+  if (disk() != file) {
+    throw vt::exception() << "eviction lost a store";
+  }
+
+  // a write through the handle replaces the mapped copy
+  std::memcpy(map + 7 * block, "stale", 5);  // NOLINT
+  vtpc_lseek(fd, 7 * block, SEEK_SET);       // NOLINT
+  if (vtpc_write(fd, "fresh", 5) != 5) {     // NOLINT
+    throw vt::exception() << "vtpc_write failed";
+  }
+  file.replace(7 * block, 5, "fresh");  // NOLINT
+  if (std::string_view(map + 7 * block, 5) != "fresh") {  // NOLINT
+    throw vt::exception() << "mapping missed a write";
+  }
+
+  // reads see a store before anything syncs the mapping
+  std::memcpy(map + 9 * block, "store", 5);  // NOLINT
+  file.replace(9 * block, 5, "store");       // NOLINT
+  std::string buf(5, 'x');                   // NOLINT
+  vtpc_lseek(fd, 9 * block, SEEK_SET);       // NOLINT
+  if (vtpc_read(fd, buf.data(), buf.size()) != 5 || buf != "store") {  // NOLINT
+    throw vt::exception() << "vtpc_read missed a store: " << buf;
+  }
+  std::memcpy(map + 11 * block, "batch", 5);  // NOLINT
+  file.replace(11 * block, 5, "batch");       // NOLINT
+  const vtpc_req req = {.buf = buf.data(), .len = buf.size(), .offset = 11 * block};  // NOLINT
+  ssize_t res = 0;
+  if (vtpc_read_batch(fd, &req, 1, &res) != 0 || res != 5 || buf != "batch") {  // NOLINT
+    throw vt::exception() << "vtpc_read_batch missed a store: " << buf;
+  }
+  std::memcpy(map + 13 * block, "dirty", 5);  // NOLINT
+  file.replace(13 * block, 5, "dirty");       // NOLINT
+  unsigned char vec = 0;
+  if (vtpc_mincore(fd, 13 * block, block, &vec) != 0 || (vec & VTPC_MINCORE_DIRTY) == 0) {  // NOLINT
+    throw vt::exception() << "vtpc_mincore missed a store";
+  }
+
+  // nor does the ring a sequential reader filled before the store
+  vtpc_fadvise(fd, 20 * block, 8 * block, POSIX_FADV_DONTNEED);  // NOLINT
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  vtpc_lseek(fd, 20 * block, SEEK_SET);  // NOLINT
+  if (vtpc_read(fd, buf.data(), buf.size()) != 5) {  // NOLINT
+    throw vt::exception() << "vtpc_read failed";
+  }
+  std::memcpy(map + 25 * block, "rings", 5);  // NOLINT
+  file.replace(25 * block, 5, "rings");       // NOLINT
+  std::string run(8 * block, 'x');            // NOLINT
+  vtpc_lseek(fd, 20 * block, SEEK_SET);       // NOLINT
+  if (vtpc_read(fd, run.data(), run.size()) != static_cast<ssize_t>(run.size()) ||
+      run != file.substr(20 * block, run.size())) {  // NOLINT
+    throw vt::exception() << "vtpc_read took a store's block from the ring";
+  }
+  if (vt::stats(fd).ring_fills == 0) {
+    throw vt::exception() << "the read did not go through the ring";
+  }
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_NORMAL);
+
+  // mapped memory cannot be a buffer of the cache's own calls
+  vtpc_lseek(fd, 0, SEEK_SET);
+  if (vtpc_read(fd, map, block) != -1 || errno != EFAULT) {
+    throw vt::exception() << "read into the mapping accepted";
+  }
+  if (vtpc_mmap(fd, 100, block) != nullptr || errno != EINVAL) {  // NOLINT
+    throw vt::exception() << "unaligned offset accepted";
+  }
+
+  std::memcpy(map + 60 * block, "unmap", 5);  // NOLINT
+  file.replace(60 * block, 5, "unmap");       // NOLINT
+  if (vtpc_munmap(map, file.size()) != 0 || vtpc_munmap(map, file.size()) == 0) {
+    throw vt::exception() << "vtpc_munmap";
+  }
+  vtpc_close(fd);
+  if (disk() != file) {
+    throw vt::exception() << "unmap lost a store";
+  }
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
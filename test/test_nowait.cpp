@@ -0,0 +1,113 @@
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 64;
+
+// Read n blocks at block b the way an event loop would: on EAGAIN, wait
+// for the eventfd and try again.
+auto read_wait(int fd, int efd, std::string& buf, size_t b, size_t n) -> int {
+  int eagain = 0;
+  size_t done = 0;
+  while (done < n * block) {
+    vtpc_lseek(fd, static_cast<off_t>(b * block + done), SEEK_SET);
+    const ssize_t got = vtpc_read(fd, buf.data() + done, n * block - done);
+    if (got > 0) {
+      done += static_cast<size_t>(got);
+      continue;
+    }
+    if (got == 0 || errno != EAGAIN) {
+      throw vt::exception() << "vtpc_read failed at block " << b;
+    }
+    ++eagain;
+    pollfd pfd = {.fd = efd, .events = POLLIN, .revents = 0};
+    if (::poll(&pfd, 1, 10000) != 1) {  // NOLINT
+      throw vt::exception() << "no completion signalled";
+    }
+    std::uint64_t count = 0;
+    (void)::read(efd, &count, sizeof(count));
+  }
+  return eagain;
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block, '\0');
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+
+  vtpc_opts opts{};
+  opts.capacity = 128 * block;
+  opts.block_size = block;
+  const int fd = vtpc_open_ex("/tmp/b", O_RDONLY | O_NONBLOCK, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  const int efd = vtpc_eventfd(fd);
+  if (efd < 0 || vtpc_eventfd(fd) != efd) {
+    throw vt::exception() << "vtpc_eventfd failed";
+  }
+
+  // a cold read fails at once, then succeeds once the fill is signalled
+  std::string buf(blocks * block, 'x');
+  if (read_wait(fd, efd, buf, 8, 8) == 0) {  // NOLINT
+    throw vt::exception() << "cold read did not return EAGAIN";
+  }
+  if (buf.substr(0, 8 * block) != file.substr(8 * block, 8 * block)) {  // NOLINT
+    throw vt::exception() << "wrong data after EAGAIN";
+  }
+  if (read_wait(fd, efd, buf, 8, 8) != 0) {  // NOLINT
+    throw vt::exception() << "resident read returned EAGAIN";
+  }
+
+  // a request that runs off the resident blocks is cut short there
+  vtpc_lseek(fd, 8 * block, SEEK_SET);  // NOLINT
+  if (vtpc_read(fd, buf.data(), 16 * block) != static_cast<ssize_t>(8 * block)) {  // NOLINT
+    throw vt::exception() << "partial read not cut at the first miss";
+  }
+
+  read_wait(fd, efd, buf, 0, blocks);
+  if (buf != file) {
+    throw vt::exception() << "wrong data";
+  }
+  const vtpc_stats st = vt::stats(fd);
+  if (st.misses != 0 || st.nowait_misses < 2) {
+    throw vt::exception() << st.misses << " blocking misses, " << st.nowait_misses
+                          << " non-blocking";
+  }
+  vtpc_close(fd);
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
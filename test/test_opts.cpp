@@ -0,0 +1,187 @@
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cmp_file.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+struct config {
+  std::string_view name;
+  void (*set)(vtpc_opts&);
+};
+
+auto run(const config& config) -> void {
+  constexpr size_t seed = 1;
+  constexpr size_t steps = (1U << 13U);
+  constexpr size_t size = (1U << 16U);
+
+  std::filesystem::remove("/tmp/a");
+  std::filesystem::remove("/tmp/b");
+
+  auto libc = vt::file::open_libc("/tmp/a");
+  vtpc_opts opts{};
+  config.set(opts);
+  auto vtpc = vt::file::open_vtpc("/tmp/b", opts);
+  vt::cmp_file file(std::move(libc), std::move(vtpc));
+
+  std::default_random_engine random(seed);  // NOLINT
+
+  std::uniform_int_distribution<size_t> action_dist(0, 100);  // NOLINT
+  std::uniform_int_distribution<off_t> offset_dist(0, size);
+  std::uniform_int_distribution<size_t> batch_dist(0, size / 8);
+  std::uniform_int_distribution<uint8_t> char_dist(0);
+
+  const auto random_string = [&](size_t size) {
+    std::string string(size, ' ');
+    for (char& c : string) {
+      c = static_cast<char>(char_dist(random));
+    }
+    return string;
+  };
+
+  file.seek(0);
+  file.write(std::string(size, ' '));
+
+  file.seek(0);
+  for (size_t i = 0; i < steps; ++i) {
+    try {
+      size_t point = action_dist(random);
+      if (point < 40) {  // NOLINT
+        file.read(batch_dist(random));
+      } else if (point < 75) {  // NOLINT
+        file.write(random_string(batch_dist(random)));
+      } else if (point < 95) {  // NOLINT
+        file.seek(offset_dist(random));
+      } else {
+        file.sync();
+      }
+    } catch (vt::file_exception& e) {  // NOLINT
+      // Do nothing
+    }
+  }
+  file.sync();
+}
+
+}  // namespace
+
+auto main() -> int try {
+  const std::vector<config> configs = {
+      {"default", [](vtpc_opts&) {}},
+      {"tiny blocks",
+       [](vtpc_opts& o) {
+         o.capacity = 2048;
+         o.block_size = 512;
+       }},
+      {"large blocks",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 18U;
+         o.block_size = 1U << 16U;
+       }},
+      {"fixed extents",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 16U;
+         o.extent_pages = 8;
+       }},
+      {"readahead 2..16",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 17U;
+         o.ra_min_pages = 2;
+         o.ra_max_pages = 16;
+       }},
+      {"2Q ratios",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.kin_pct = 10;
+         o.kout_pct = 200;
+       }},
+      {"buffered io",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.io = VTPC_IO_BUFFERED;
+       }},
+      {"arc",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_ARC;
+       }},
+      {"s3fifo",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_S3FIFO;
+       }},
+      {"lirs",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_LIRS;
+       }},
+      {"opt",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_OPT;
+       }},
+      {"lru-2",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_LRUK;
+       }},
+      {"lru-3 crp 4",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_LRUK;
+         o.lru_k = 3;
+         o.lru_k_crp = 4;
+       }},
+      {"greedydual",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_GD;
+       }},
+      {"tinylfu",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.admission = VTPC_ADMIT_TINYLFU;
+       }},
+      {"tinylfu s3fifo",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.policy = VTPC_POLICY_S3FIFO;
+         o.admission = VTPC_ADMIT_TINYLFU;
+       }},
+      {"declared stream",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.access = VTPC_ACCESS_SEQUENTIAL;
+       }},
+      {"declared loop",
+       [](vtpc_opts& o) {
+         o.capacity = 1U << 15U;
+         o.access = VTPC_ACCESS_LOOPING;
+       }},
+  };
+
+  for (const config& config : configs) {
+    std::cerr << "config: " << config.name << '\n';
+    run(config);
+  }
+
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
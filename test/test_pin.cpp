@@ -0,0 +1,137 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 1024;
+constexpr size_t hot = 4;
+
+struct config {
+  std::string_view name;
+  vtpc_policy policy;
+  vtpc_admission admission;
+};
+
+const std::vector<config> configs = {
+    {"2q", VTPC_POLICY_2Q, VTPC_ADMIT_DEFAULT},
+    {"arc", VTPC_POLICY_ARC, VTPC_ADMIT_DEFAULT},
+    {"s3fifo", VTPC_POLICY_S3FIFO, VTPC_ADMIT_DEFAULT},
+    {"lirs", VTPC_POLICY_LIRS, VTPC_ADMIT_DEFAULT},
+    {"opt", VTPC_POLICY_OPT, VTPC_ADMIT_DEFAULT},
+    {"lruk", VTPC_POLICY_LRUK, VTPC_ADMIT_DEFAULT},
+    {"gd", VTPC_POLICY_GD, VTPC_ADMIT_DEFAULT},
+    {"2q tinylfu", VTPC_POLICY_2Q, VTPC_ADMIT_TINYLFU},
+};
+
+auto read_block(int fd, std::string& buf, size_t b) -> void {
+  vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET);
+  if (vtpc_read(fd, buf.data(), block) != static_cast<ssize_t>(block)) {
+    throw vt::exception() << "vtpc_read failed at block " << b;
+  }
+}
+
+// Pinned blocks survive a burst of cold reads, stay dirty until written
+// back, and return to the policy when unpinned.
+auto run(const config& config) -> void {
+  std::filesystem::remove("/tmp/b");
+  vtpc_opts opts{};
+  opts.capacity = 64 * block;  // NOLINT
+  opts.block_size = block;
+  opts.policy = config.policy;
+  opts.admission = config.admission;
+
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  const std::string zeros(blocks * block, '\0');
+  if (vtpc_write(fd, zeros.data(), zeros.size()) != static_cast<ssize_t>(zeros.size())) {
+    throw vt::exception() << "vtpc_write failed";
+  }
+
+  if (vtpc_pin(fd, 0, hot * block) != 0) {
+    throw vt::exception() << "vtpc_pin failed";
+  }
+  vtpc_lseek(fd, 2 * block, SEEK_SET);
+  if (vtpc_write(fd, "root", 4) != 4) {  // NOLINT
+    throw vt::exception() << "vtpc_write failed";
+  }
+  const size_t pinned = vt::stats(fd).pinned_bytes;
+  if (pinned < hot * block) {
+    throw vt::exception() << "pinned " << pinned << " bytes";
+  }
+
+  std::string buf(block, 'x');
+  std::default_random_engine random(1);  // NOLINT
+  std::uniform_int_distribution<size_t> cold(100, blocks - 1);  // NOLINT
+  for (size_t i = 0; i < 2000; ++i) read_block(fd, buf, cold(random));  // NOLINT
+  const unsigned long long misses = vt::stats(fd).misses;
+  for (size_t b = 0; b < hot; ++b) read_block(fd, buf, b);
+  if (vt::stats(fd).misses != misses) {
+    throw vt::exception() << "a pinned block was evicted";
+  }
+
+  // a quarter of the cache at most, and nothing pinned on failure
+  if (vtpc_pin(fd, 100 * block, 20 * block) == 0 || errno != ENOMEM ||  // NOLINT
+      vt::stats(fd).pinned_bytes != pinned) {
+    throw vt::exception() << "pin over budget accepted";
+  }
+
+  if (vtpc_fsync(fd) != 0) {
+    throw vt::exception() << "vtpc_fsync failed";
+  }
+  const int os = ::open("/tmp/b", O_RDONLY);
+  char disk[4] = {};
+  const ssize_t got = ::pread(os, disk, sizeof(disk), 2 * block);
+  ::close(os);
+  if (got != 4 || std::string_view(disk, 4) != "root") {  // NOLINT
+    throw vt::exception() << "pinned dirty block not written back";
+  }
+
+  vtpc_unpin(fd, 0, hot * block);
+  if (vt::stats(fd).pinned_bytes != 0) {
+    throw vt::exception() << "unpin left " << vt::stats(fd).pinned_bytes << " bytes pinned";
+  }
+  for (size_t i = 0; i < 2000; ++i) read_block(fd, buf, cold(random));  // NOLINT
+  read_block(fd, buf, 2);
+  if (std::string_view(buf.data(), 4) != "root") {  // NOLINT
+    throw vt::exception() << "wrong data after unpin";
+  }
+  vtpc_close(fd);
+  std::filesystem::remove("/tmp/b");
+}
+
+}  // namespace
+
+auto main() -> int try {
+  for (const config& config : configs) {
+    try {
+      run(config);
+    } catch (const std::exception& e) {
+      throw vt::exception() << config.name << ": " << e.what();
+    }
+  }
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
@@ -0,0 +1,513 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 4096;
+
+// Options under which every block goes through the policy one at a time,
+// in one-block extents.
+auto policy_opts(vtpc_policy policy, size_t capacity) -> vtpc_opts {
+  vtpc_opts opts{};
+  opts.capacity = capacity * block;
+  opts.block_size = block;
+  opts.extent_pages = 1;
+  opts.policy = policy;
+  opts.admission = VTPC_ADMIT_ALL;
+  opts.access = VTPC_ACCESS_RANDOM;
+  opts.prefetch = VTPC_PREFETCH_NONE;
+  return opts;
+}
+
+auto open_opts(const vtpc_opts& opts) -> int {
+  const int fd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  return fd;
+}
+
+auto open_policy(vtpc_policy policy, size_t capacity,
+                 vtpc_admission admission = VTPC_ADMIT_ALL) -> int {
+  vtpc_opts opts = policy_opts(policy, capacity);
+  opts.admission = admission;
+  return open_opts(opts);
+}
+
+auto touch(int fd, size_t b) -> void {
+  std::string buf(block, 'x');
+  vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET);
+  if (vtpc_read(fd, buf.data(), block) != static_cast<ssize_t>(block)) {
+    throw vt::exception() << "vtpc_read failed at block " << b;
+  }
+}
+
+// The policy a fresh process gives a handle with VTPC_POLICY set to env
+// (unset for nullptr): its stats name, or "EINVAL" if the open is refused.
+// The library reads the environment once, so each check runs in a child.
+auto env_policy(const char* env, vtpc_policy policy = VTPC_POLICY_DEFAULT) -> std::string {
+  int out[2];
+  if (::pipe(out) != 0) {
+    throw vt::exception() << "pipe failed";
+  }
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    ::close(out[0]);
+    if (env) {
+      setenv("VTPC_POLICY", env, 1);
+    } else {
+      unsetenv("VTPC_POLICY");
+    }
+    vtpc_opts opts{};
+    opts.block_size = block;
+    opts.policy = policy;
+    const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+    const std::string name = fd >= 0 ? vt::stats(fd).policy : errno == EINVAL ? "EINVAL" : "error";
+    (void)!::write(out[1], name.data(), name.size());
+    _exit(0);
+  }
+  ::close(out[1]);
+  std::string name(32, '\0');  // NOLINT
+  const ssize_t got = ::read(out[0], name.data(), name.size());
+  ::close(out[0]);
+  ::waitpid(pid, nullptr, 0);
+  name.resize(got > 0 ? static_cast<size_t>(got) : 0);
+  return name;
+}
+
+// VTPC_POLICY picks the process default by name; vtpc_opts.policy picks
+// one per handle and wins over it.
+auto check_selection() -> void {
+  const std::vector<std::pair<const char*, std::string_view>> envs = {
+      {nullptr, "2q"}, {"2q", "2q"}, {"arc", "arc"}, {"s3fifo", "s3fifo"},
+      {"lirs", "lirs"}, {"opt", "opt"}, {"lruk", "lruk"}, {"gd", "gd"},
+      {"ARC", "arc"},   {"bogus", "EINVAL"},
+  };
+  for (const auto& [env, want] : envs) {
+    const std::string got = env_policy(env);
+    if (got != want) {
+      throw vt::exception() << "VTPC_POLICY=" << (env ? env : "(unset)") << ": " << got;
+    }
+  }
+  if (env_policy("arc", VTPC_POLICY_2Q) != "2q" ||
+      env_policy("bogus", VTPC_POLICY_GD) != "gd") {
+    throw vt::exception() << "vtpc_opts.policy did not win over VTPC_POLICY";
+  }
+
+  const std::vector<std::pair<vtpc_policy, std::string_view>> handles = {
+      {VTPC_POLICY_2Q, "2q"},
+      {VTPC_POLICY_ARC, "arc"},
+      {VTPC_POLICY_S3FIFO, "s3fifo"},
+      {VTPC_POLICY_LIRS, "lirs"},
+      {VTPC_POLICY_OPT, "opt"},
+      {VTPC_POLICY_LRUK, "lruk"},
+      {VTPC_POLICY_GD, "gd"},
+  };
+  for (const auto& [policy, want] : handles) {
+    vtpc_opts opts{};
+    opts.block_size = block;
+    opts.policy = policy;
+    const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+    if (fd < 0 || vt::stats(fd).policy != want) {
+      throw vt::exception() << "policy " << policy << " not applied";
+    }
+    vtpc_close(fd);
+  }
+  vtpc_opts opts{};
+  opts.policy = static_cast<vtpc_policy>(42);  // NOLINT
+  if (vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts) >= 0 || errno != EINVAL) {
+    throw vt::exception() << "unknown policy accepted";
+  }
+}
+
+auto hit_ratio(int fd) -> double {
+  const vtpc_stats st = vt::stats(fd);
+  return static_cast<double>(st.hits) / static_cast<double>(st.hits + st.misses);
+}
+
+auto resident(int fd, size_t b) -> bool {
+  unsigned char vec = 0;
+  vtpc_mincore(fd, static_cast<off_t>(b * block), block, &vec);
+  return (vec & VTPC_MINCORE_RESIDENT) != 0;
+}
+
+// ARC moves its T1 target towards whichever side its ghost hits come from:
+// up while re-read blocks were recently evicted once-seen ones, back down
+// when they were evicted frequent ones.
+auto check_arc() -> void {
+  const int fd = open_policy(VTPC_POLICY_ARC, 32);  // NOLINT
+  for (size_t b = 0; b < 24; ++b) {                  // NOLINT
+    touch(fd, b);
+    touch(fd, b);
+  }
+  // a loop of once-read blocks, twice the room T2 leaves it
+  for (size_t pass = 0; pass < 4; ++pass) {  // NOLINT
+    for (size_t b = 100; b < 116; ++b) {      // NOLINT
+      touch(fd, b);
+    }
+  }
+  const size_t recency = vt::stats(fd).arc_p;
+  // a loop of twice-read blocks, larger than the cache
+  for (size_t pass = 0; pass < 4; ++pass) {  // NOLINT
+    for (size_t b = 200; b < 240; ++b) {      // NOLINT
+      touch(fd, b);
+      touch(fd, b);
+    }
+  }
+  const size_t frequency = vt::stats(fd).arc_p;
+  vtpc_close(fd);
+  if (recency == 0 || frequency >= recency) {
+    throw vt::exception() << "arc_p went 0 -> " << recency << " -> " << frequency;
+  }
+}
+
+// S3-FIFO: a hit only counts. The block keeps its place in the small FIFO
+// and moves to the main one when it reaches the tail, so blocks read twice
+// outlive a stream of one-shot blocks twice the cache, and their
+// neighbours, read once, do not.
+auto check_s3fifo() -> void {
+  const int fd = open_policy(VTPC_POLICY_S3FIFO, 20);  // NOLINT
+  for (size_t b = 0; b < 20; ++b) {                     // NOLINT
+    touch(fd, b);
+  }
+  touch(fd, 0);
+  touch(fd, 10);  // NOLINT
+  for (size_t b = 100; b < 140; ++b) {  // NOLINT
+    touch(fd, b);
+  }
+  for (const size_t b : {0, 10}) {  // NOLINT
+    if (!resident(fd, b)) {
+      throw vt::exception() << "s3fifo: block " << b << " evicted";
+    }
+  }
+  for (size_t b = 1; b < 20; ++b) {  // NOLINT
+    if (b % 10 != 0 && resident(fd, b)) {  // NOLINT
+      throw vt::exception() << "s3fifo: block " << b << " kept";
+    }
+  }
+  vtpc_close(fd);
+}
+
+// Hit ratio of a loop over a fifth more blocks than the cache holds.
+auto loop_hit_ratio(vtpc_policy policy) -> double {
+  const int fd = open_policy(policy, 100);  // NOLINT
+  for (size_t pass = 0; pass < 10; ++pass) {  // NOLINT
+    for (size_t b = 0; b < 120; ++b) {        // NOLINT
+      touch(fd, b);
+    }
+  }
+  const double ratio = hit_ratio(fd);
+  vtpc_close(fd);
+  return ratio;
+}
+
+// LIRS keeps most of a loop slightly larger than the cache, where ARC's
+// recency lists evict each block just before it comes round. 2Q keeps
+// part of it, through A1out, but less.
+auto check_lirs() -> void {
+  const double lirs = loop_hit_ratio(VTPC_POLICY_LIRS);
+  const double arc = loop_hit_ratio(VTPC_POLICY_ARC);
+  const double q2 = loop_hit_ratio(VTPC_POLICY_2Q);
+  if (lirs < 0.5 || arc > 0.05 || q2 >= lirs) {  // NOLINT
+    throw vt::exception() << "loop hit ratio: lirs " << lirs << ", arc " << arc << ", 2q " << q2;
+  }
+}
+
+constexpr size_t hot = 16;
+
+// Hot blocks, read eight times each, left resident after 900 one-shot
+// blocks went through a 128-block cache.
+auto hot_kept(vtpc_policy policy, vtpc_admission admission, unsigned long long* rejects)
+    -> size_t {
+  const int fd = open_policy(policy, 128, admission);  // NOLINT
+  for (size_t pass = 0; pass < 8; ++pass) {            // NOLINT
+    for (size_t b = 0; b < hot; ++b) {
+      touch(fd, b);
+    }
+  }
+  for (size_t b = 100; b < 1000; ++b) {  // NOLINT
+    touch(fd, b);
+  }
+  size_t kept = 0;
+  for (size_t b = 0; b < hot; ++b) {
+    kept += resident(fd, b) ? 1 : 0;
+  }
+  *rejects = vt::stats(fd).admit_rejects;
+  vtpc_close(fd);
+  return kept;
+}
+
+// TinyLFU turns one-shot blocks away at its window, so they do not displace
+// a hot set; without it, GreedyDual's rising L ages the hot blocks out. The
+// sketch may let the odd one-shot through on a counter collision.
+auto check_tinylfu() -> void {
+  unsigned long long rejects = 0;
+  for (const vtpc_policy policy : {VTPC_POLICY_2Q, VTPC_POLICY_S3FIFO, VTPC_POLICY_GD}) {
+    const size_t tinylfu = hot_kept(policy, VTPC_ADMIT_TINYLFU, &rejects);
+    if (tinylfu + 1 < hot || rejects == 0) {
+      throw vt::exception() << "tinylfu: " << tinylfu << " hot blocks kept, " << rejects
+                            << " rejects";
+    }
+  }
+  const size_t all = hot_kept(VTPC_POLICY_GD, VTPC_ADMIT_ALL, &rejects);
+  if (all * 2 > hot) {
+    throw vt::exception() << "without tinylfu " << all << " hot blocks were kept as well";
+  }
+}
+
+auto advise(int fd, size_t b, unsigned long long when) -> void {
+  if (vtpc_advice(fd, static_cast<off_t>(b * block), block, when) != 0) {
+    throw vt::exception() << "vtpc_advice failed at block " << b;
+  }
+}
+
+auto expect_resident(std::string_view policy, int fd, size_t b, bool want) -> void {
+  if (resident(fd, b) != want) {
+    throw vt::exception() << policy << ": block " << b << (want ? " evicted" : " kept");
+  }
+}
+
+// GreedyDual adds a dirty block's write-back to what it costs: of blocks
+// read one after another, those written right after their read outlast the
+// ones left clean when new blocks push half of them out. The read cost is
+// fixed, but the write-back cost is measured.
+auto check_gd_dirty() -> void {
+  constexpr size_t n = 64;
+  vtpc_opts opts = policy_opts(VTPC_POLICY_GD, n);
+  opts.cost_ns = 1000;  // NOLINT
+  const int fd = open_opts(opts);
+  const std::string data(block, 'x');
+  for (size_t b = 0; b < n; ++b) {
+    touch(fd, b);
+    if (b % 2 == 1 && (vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET) < 0 ||
+                       vtpc_write(fd, data.data(), block) != static_cast<ssize_t>(block))) {
+      throw vt::exception() << "vtpc_write failed at block " << b;
+    }
+  }
+  for (size_t b = 100; b < 100 + n / 2; ++b) {  // NOLINT
+    touch(fd, b);
+  }
+  size_t kept[2] = {0, 0};
+  for (size_t b = 0; b < n; ++b) {
+    kept[b % 2] += resident(fd, b) ? 1 : 0;
+  }
+  vtpc_close(fd);
+  if (kept[1] <= kept[0]) {
+    throw vt::exception() << "gd: " << kept[1] << " dirty blocks kept, " << kept[0] << " clean";
+  }
+}
+
+// How many of fd's blocks [0, n) are resident.
+auto resident_blocks(int fd, size_t n) -> size_t {
+  size_t kept = 0;
+  for (size_t b = 0; b < n; ++b) {
+    kept += resident(fd, b) ? 1 : 0;
+  }
+  return kept;
+}
+
+// In a GreedyDual pool a block is worth what a miss costs its own handle:
+// of the same one-shot reads through two handles, the one whose reads cost
+// four times as much keeps most of the pool.
+auto check_gd_pool() -> void {
+  constexpr size_t n = 512;
+  vtpc_opts opts = policy_opts(VTPC_POLICY_GD, 64);  // NOLINT
+  opts.pool = vtpc_pool_create(&opts);
+  if (opts.pool <= 0) {
+    throw vt::exception() << "vtpc_pool_create failed";
+  }
+  opts.cost_ns = 4000;  // NOLINT
+  const int slow = open_opts(opts);
+  opts.cost_ns = 1000;  // NOLINT
+  const int fast = open_opts(opts);
+  for (size_t b = 0; b < n; ++b) {
+    touch(slow, b);
+    touch(fast, b);
+  }
+  const size_t kept_slow = resident_blocks(slow, n);
+  const size_t kept_fast = resident_blocks(fast, n);
+  vtpc_close(fast);
+  vtpc_close(slow);
+  vtpc_pool_destroy(opts.pool);
+  if (kept_slow <= 2 * kept_fast) {
+    throw vt::exception() << "gd pool: the slow handle kept " << kept_slow << " blocks, the fast one "
+                          << kept_fast;
+  }
+}
+
+// OPT evicts the block whose announced next use is furthest away, but
+// blocks without a hint go first, through its 2Q fallback. A hint given to
+// a pinned block applies once it is unpinned.
+auto check_opt() -> void {
+  const int fd = open_policy(VTPC_POLICY_OPT, 16);  // NOLINT
+  for (size_t b = 0; b < 16; ++b) {                  // NOLINT
+    touch(fd, b);
+    advise(fd, b, 100 + b);  // NOLINT
+  }
+  touch(fd, 50);  // NOLINT
+  touch(fd, 51);  // NOLINT
+  for (size_t b = 0; b < 15; ++b) {  // NOLINT
+    expect_resident("opt", fd, b, true);
+  }
+  expect_resident("opt", fd, 15, false);  // NOLINT
+  expect_resident("opt", fd, 50, false);  // NOLINT
+
+  if (vtpc_pin(fd, 3 * block, block) != 0) {  // NOLINT
+    throw vt::exception() << "vtpc_pin failed";
+  }
+  advise(fd, 3, 10);  // NOLINT
+  if (vtpc_unpin(fd, 3 * block, block) != 0) {  // NOLINT
+    throw vt::exception() << "vtpc_unpin failed";
+  }
+  advise(fd, 51, 20);  // NOLINT
+  touch(fd, 52);       // NOLINT
+  expect_resident("opt", fd, 14, false);  // NOLINT
+  expect_resident("opt", fd, 3, true);    // NOLINT
+  vtpc_close(fd);
+}
+
+// LRU-K counts a burst of reads within the correlated reference period as
+// one reference: a block read twice in a row still has an infinite
+// K-distance and goes before one read twice far apart, though its last
+// read is the more recent.
+auto check_lruk() -> void {
+  vtpc_opts opts = policy_opts(VTPC_POLICY_LRUK, 8);  // NOLINT
+  opts.lru_k = 2;
+  opts.lru_k_crp = 4;  // NOLINT
+  const int fd = open_opts(opts);
+  touch(fd, 0);
+  for (size_t b = 10; b < 14; ++b) {  // NOLINT
+    touch(fd, b);
+  }
+  touch(fd, 0);
+  touch(fd, 1);
+  touch(fd, 1);
+  for (size_t b = 20; b < 27; ++b) {  // NOLINT
+    touch(fd, b);
+  }
+  expect_resident("lruk", fd, 0, true);
+  expect_resident("lruk", fd, 1, false);
+  vtpc_close(fd);
+}
+
+// 2Q's Kin and Kout as the stats report them, checked against their bounds
+// after every read.
+struct q2_tuning {
+  int fd;
+  size_t capacity;
+  vtpc_stats st{};
+
+  auto touch(size_t b) -> void {
+    ::touch(fd, b);
+    st = vt::stats(fd);
+    if (st.kin < capacity / 20 || st.kin > capacity / 4 * 3) {  // NOLINT
+      throw vt::exception() << "2q: Kin " << st.kin << " out of bounds";
+    }
+    if (st.kout < capacity / 4 || st.kout > capacity * 3) {
+      throw vt::exception() << "2q: Kout " << st.kout << " out of bounds";
+    }
+  }
+
+  auto kin() const -> size_t { return st.kin / block; }
+  auto kout() const -> size_t { return st.kout / block; }
+};
+
+// Left to tune itself, 2Q moves Kin toward whichever ghost list is hit and
+// Kout toward what its older ghosts earn, each up to its bound and no
+// further.
+auto check_q2_tuning() -> void {
+  constexpr size_t capacity = 64;
+  q2_tuning q{open_policy(VTPC_POLICY_2Q, capacity), capacity * block};
+  q.st = vt::stats(q.fd);
+  const auto expect = [&](std::string_view what, size_t got, size_t want) {
+    if (got != want) {
+      throw vt::exception() << "2q: " << what << " ended at " << got << ", not " << want;
+    }
+  };
+
+  // each new block read again just after A1in lets it go: Kin grows
+  size_t next = 0;
+  for (; next < 400; ++next) {  // NOLINT
+    q.touch(next);
+    if (next > q.kin()) {
+      q.touch(next - q.kin() - 1);
+    }
+  }
+  expect("Kin", q.st.kin, q.capacity / 4 * 3);
+
+  // twice-read blocks looped just past what Am holds: Kin shrinks
+  for (size_t lap = 0; lap < 60; ++lap) {  // NOLINT
+    const size_t am = capacity - q.kin() + 2;
+    for (size_t b = 4000; b < 4000 + am; ++b) {  // NOLINT
+      q.touch(b);
+      q.touch(b);
+    }
+  }
+  expect("Kin", q.st.kin, q.capacity / 20);
+
+  // blocks read twice at an old A1out age: Kout grows while they earn hits,
+  // then shrinks while they are read once only
+  for (const bool useful : {true, false}) {
+    for (const size_t end = next + 1600; next < end; ++next) {  // NOLINT
+      q.touch(next);
+      const size_t age = q.kin() + q.kout() * 3 / 4;  // NOLINT
+      q.touch(next - age);
+      if (useful) {
+        q.touch(next - age);
+      }
+    }
+    expect("Kout", q.st.kout, useful ? q.capacity * 3 : q.capacity / 4);
+  }
+  vtpc_close(q.fd);
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  check_selection();
+
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    const std::string file(blocks * block, 'x');
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+  check_arc();
+  check_s3fifo();
+  check_lirs();
+  check_tinylfu();
+  check_gd_dirty();
+  check_gd_pool();
+  check_opt();
+  check_lruk();
+  check_q2_tuning();
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
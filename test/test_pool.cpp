@@ -0,0 +1,255 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cmp_file.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+struct config {
+  std::string_view name;
+  vtpc_policy policy;
+};
+
+auto run(const config& config) -> bool {
+  constexpr size_t seed = 1;
+  constexpr size_t steps = (1U << 13U);
+  constexpr size_t size = (1U << 16U);
+
+  vtpc_opts pool_opts{};
+  pool_opts.capacity = 1U << 16U;
+  pool_opts.policy = config.policy;
+
+  const int pool = vtpc_pool_create(&pool_opts);
+  if (pool <= 0) {
+    std::cerr << "vtpc_pool_create failed\n";
+    return false;
+  }
+
+  {
+    for (const char* path : {"/tmp/a", "/tmp/b", "/tmp/c", "/tmp/d"}) {
+      std::filesystem::remove(path);
+    }
+
+    vtpc_opts opts{};
+    opts.pool = pool;
+    std::vector<std::unique_ptr<vt::cmp_file>> files;
+    files.push_back(std::make_unique<vt::cmp_file>(
+        vt::file::open_libc("/tmp/a"), vt::file::open_vtpc("/tmp/b", opts)));
+    files.push_back(std::make_unique<vt::cmp_file>(
+        vt::file::open_libc("/tmp/c"), vt::file::open_vtpc("/tmp/d", opts)));
+
+    if (vtpc_pool_destroy(pool) == 0 || errno != EBUSY) {
+      std::cerr << "pool destroyed while in use\n";
+      return false;
+    }
+
+    std::default_random_engine random(seed);  // NOLINT
+
+    std::uniform_int_distribution<size_t> file_dist(0, files.size() - 1);
+    std::uniform_int_distribution<size_t> action_dist(0, 100);  // NOLINT
+    std::uniform_int_distribution<off_t> offset_dist(0, size);
+    std::uniform_int_distribution<size_t> batch_dist(0, size / 8);
+    std::uniform_int_distribution<uint8_t> char_dist(0);
+
+    const auto random_string = [&](size_t size) {
+      std::string string(size, ' ');
+      for (char& c : string) {
+        c = static_cast<char>(char_dist(random));
+      }
+      return string;
+    };
+
+    for (const auto& file : files) {
+      file->seek(0);
+      file->write(std::string(size, ' '));
+      file->seek(0);
+    }
+
+    for (size_t i = 0; i < steps; ++i) {
+      vt::cmp_file& file = *files[file_dist(random)];
+      try {
+        size_t point = action_dist(random);
+        if (point < 40) {  // NOLINT
+          file.read(batch_dist(random));
+        } else if (point < 75) {  // NOLINT
+          file.write(random_string(batch_dist(random)));
+        } else if (point < 95) {  // NOLINT
+          file.seek(offset_dist(random));
+        } else {
+          file.sync();
+        }
+      } catch (vt::file_exception& e) {  // NOLINT
+        // Do nothing
+      }
+    }
+
+    for (const auto& file : files) {
+      file->sync();
+    }
+  }
+
+  if (vtpc_pool_destroy(pool) != 0) {
+    std::cerr << "vtpc_pool_destroy failed\n";
+    return false;
+  }
+  return true;
+}
+
+// No file takes blocks below VTPC_MIN_BLOCK_SIZE, so neither does a pool.
+auto check_block_size() -> bool {
+  vtpc_opts opts{};
+  opts.block_size = 256;  // NOLINT
+  if (vtpc_pool_create(&opts) >= 0 || errno != EINVAL) {
+    std::cerr << "a pool of 256-byte blocks was created\n";
+    return false;
+  }
+  return true;
+}
+
+constexpr size_t block = 4096;
+
+auto touch(int fd, size_t b) -> bool {
+  std::string buf(block, 'x');
+  return vtpc_lseek(fd, static_cast<off_t>(b * block), SEEK_SET) >= 0 &&
+         vtpc_read(fd, buf.data(), block) == static_cast<ssize_t>(block);
+}
+
+auto resident(int fd, size_t b) -> bool {
+  unsigned char vec = 0;
+  vtpc_mincore(fd, static_cast<off_t>(b * block), block, &vec);
+  return (vec & VTPC_MINCORE_RESIDENT) != 0;
+}
+
+// Runs first on a 64-block file in a pool of 8 blocks, closes it, and runs
+// second on another file opened into the handle slot it freed. Returns
+// whether both passed.
+auto slot_reused(vtpc_policy policy, auto&& first, auto&& second) -> bool {
+  vtpc_opts opts{};
+  opts.capacity = 8 * block;  // NOLINT
+  opts.block_size = block;
+  opts.policy = policy;
+  opts.lru_k_crp = 1;
+  const int pool = vtpc_pool_create(&opts);
+  if (pool <= 0) {
+    std::cerr << "vtpc_pool_create failed\n";
+    return false;
+  }
+  opts.pool = pool;
+  opts.extent_pages = 1;
+
+  bool ok = true;
+  int slot = -1;
+  for (const char* path : {"/tmp/b", "/tmp/d"}) {
+    std::ofstream(path, std::ios::binary) << std::string(64 * block, ' ');  // NOLINT
+    const int fd = vtpc_open_ex(path, O_RDWR, 0, &opts);
+    if (fd < 0 || (slot >= 0 && fd != slot)) {
+      std::cerr << "vtpc_open_ex did not reuse the slot\n";
+      return false;
+    }
+    ok = ok && (slot < 0 ? first(fd) : second(fd));
+    slot = fd;
+    vtpc_close(fd);
+  }
+  vtpc_pool_destroy(pool);
+  std::filesystem::remove("/tmp/b");
+  std::filesystem::remove("/tmp/d");
+  return ok;
+}
+
+// A closed handle takes its ghosts, history and hints with it.
+auto check_slot_reuse() -> bool {
+  for (const vtpc_policy policy :
+       {VTPC_POLICY_2Q, VTPC_POLICY_ARC, VTPC_POLICY_S3FIFO, VTPC_POLICY_LIRS}) {
+    unsigned long long ghost_hits = 0;
+    std::string name;
+    const bool ok = slot_reused(
+        policy,
+        [](int fd) {
+          for (size_t b = 0; b < 32; ++b) {  // NOLINT
+            touch(fd, b);
+          }
+          return true;
+        },
+        [&](int fd) {
+          const vtpc_stats before = vt::stats(fd);
+          for (size_t b = 24; b < 32; ++b) {  // NOLINT: resident at the close
+            touch(fd, b);
+          }
+          const vtpc_stats after = vt::stats(fd);
+          ghost_hits = after.ghost_hits - before.ghost_hits;
+          name = after.policy;
+          return ghost_hits == 0;
+        });
+    if (!ok) {
+      std::cerr << name << ": " << ghost_hits
+                << " ghost hits on the closed handle's blocks\n";
+      return false;
+    }
+  }
+
+  // blocks read twice, or given a hint, would outlast the one-shot ones
+  const auto evicts_block_0 = [](int fd) {
+    touch(fd, 0);
+    for (size_t b = 1; b <= 8; ++b) {  // NOLINT
+      touch(fd, b);
+    }
+    return !resident(fd, 0);
+  };
+  if (!slot_reused(
+          VTPC_POLICY_LRUK,
+          [](int fd) { return touch(fd, 0) && touch(fd, 10) && touch(fd, 0); },  // NOLINT
+          evicts_block_0)) {
+    std::cerr << "lruk: the closed handle's history was kept\n";
+    return false;
+  }
+  if (!slot_reused(
+          VTPC_POLICY_OPT, [](int fd) { return vtpc_advice(fd, 0, block, 1) == 0; },
+          evicts_block_0)) {
+    std::cerr << "opt: the closed handle's hint was kept\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+auto main() -> int try {
+  const std::vector<config> configs = {
+      {"2q pool", VTPC_POLICY_DEFAULT},
+      {"arc pool", VTPC_POLICY_ARC},
+      {"gd pool", VTPC_POLICY_GD},
+  };
+
+  for (const config& config : configs) {
+    std::cerr << "config: " << config.name << '\n';
+    if (!run(config)) {
+      return 1;
+    }
+  }
+  if (!check_block_size() || !check_slot_reuse()) {
+    return 1;
+  }
+
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
@@ -0,0 +1,169 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cmp_file.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 256;
+
+struct walk {
+  std::string_view name;
+  off_t first;    // block
+  off_t stride;   // blocks between run starts
+  size_t run;     // blocks read per run
+};
+
+const std::vector<walk> walks = {
+    {"stride 8", 0, 8, 1},
+    {"stride 8, runs of 2", 3, 8, 2},
+    {"backward", blocks - 1, -1, 1},
+    {"backward, runs of 4", blocks - 4, -4, 4},
+    {"backward stride 5", blocks - 2, -5, 1},
+};
+
+// Index-like lookups: a random key block, then the same two blocks after it.
+auto chains(size_t count, auto&& fn) -> void {
+  constexpr size_t keys = 24;
+  std::default_random_engine random(2);  // NOLINT
+  std::uniform_int_distribution<size_t> key_dist(0, keys - 1);
+  for (size_t i = 0; i < count; ++i) {
+    const size_t key = key_dist(random);
+    for (size_t b : {key, keys + ((key * 7) % keys), 2 * keys + ((key * 5) % keys)}) {
+      fn(static_cast<off_t>(b * block), block);
+    }
+  }
+}
+
+auto visit(const walk& w, auto&& fn) -> void {
+  for (off_t b = w.first; b >= 0 && b + static_cast<off_t>(w.run) <= static_cast<off_t>(blocks);
+       b += w.stride) {
+    fn(b * static_cast<off_t>(block), w.run * block);
+  }
+}
+
+auto prefetch_opts(size_t capacity, vtpc_prefetch prefetch, size_t extent_pages = 0)
+    -> vtpc_opts {
+  vtpc_opts opts{};
+  opts.capacity = capacity * block;
+  opts.block_size = block;
+  opts.extent_pages = extent_pages;
+  opts.prefetch = prefetch;
+  return opts;
+}
+
+// Strided and backward walks, read and rewritten, against libc.
+auto check_data(const vtpc_opts& opts) -> void {
+  std::filesystem::remove("/tmp/a");
+  std::filesystem::remove("/tmp/b");
+
+  auto libc = vt::file::open_libc("/tmp/a");
+  auto vtpc = vt::file::open_vtpc("/tmp/b", opts);
+  vt::cmp_file file(std::move(libc), std::move(vtpc));
+
+  std::default_random_engine random(1);  // NOLINT
+  std::uniform_int_distribution<uint8_t> char_dist(0);
+  const auto random_string = [&](size_t size) {
+    std::string string(size, ' ');
+    for (char& c : string) {
+      c = static_cast<char>(char_dist(random));
+    }
+    return string;
+  };
+
+  file.seek(0);
+  file.write(random_string(blocks * block));
+
+  for (const walk& w : walks) {
+    visit(w, [&](off_t off, size_t len) {
+      file.seek(off);
+      file.read(len);
+    });
+    visit(w, [&](off_t off, size_t len) {
+      file.seek(off + 17);  // NOLINT
+      file.write(random_string(len / 2));
+    });
+  }
+  size_t n = 0;
+  chains(400, [&](off_t off, size_t len) {  // NOLINT
+    file.seek(off);
+    if (++n % 16 == 0) {  // NOLINT
+      file.write(random_string(len / 4));
+    } else {
+      file.read(len);
+    }
+  });
+  file.sync();
+}
+
+// Reads the walks and chains straight through vtpc and returns the stats.
+auto read_stats(const vtpc_opts& opts) -> vtpc_stats {
+  const int fd = vtpc_open_ex("/tmp/b", O_RDONLY, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+  std::string buf(blocks * block, ' ');
+  const auto read = [&](off_t off, size_t len) {
+    if (vtpc_lseek(fd, off, SEEK_SET) != off ||
+        vtpc_read(fd, buf.data(), len) != static_cast<ssize_t>(len)) {
+      throw vt::exception() << "read failed at " << off;
+    }
+  };
+  for (const walk& w : walks) {
+    visit(w, read);
+  }
+  chains(400, read);  // NOLINT
+  vtpc_stats st{};
+  vtpc_get_stats(fd, &st);
+  vtpc_close(fd);
+  if (st.prefetch_hits > st.prefetches || st.markov_hits > st.markov_prefetches) {
+    throw vt::exception() << "more prefetch hits than prefetches";
+  }
+  return st;
+}
+
+}  // namespace
+
+auto main() -> int try {
+  const vtpc_opts on = prefetch_opts(64, VTPC_PREFETCH_DEFAULT);
+  const vtpc_opts off = prefetch_opts(64, VTPC_PREFETCH_NONE);
+  const vtpc_opts markov = prefetch_opts(16, VTPC_PREFETCH_MARKOV);
+
+  check_data(on);
+  check_data(markov);
+  check_data(prefetch_opts(8, VTPC_PREFETCH_DEFAULT));
+  check_data(prefetch_opts(64, VTPC_PREFETCH_DEFAULT, 4));
+
+  if (read_stats(on).prefetch_hits == 0) {
+    throw vt::exception() << "strided reads were not prefetched";
+  }
+  if (read_stats(off).prefetch_hits != 0) {
+    throw vt::exception() << "prefetched with VTPC_PREFETCH_NONE";
+  }
+  const vtpc_stats st = read_stats(markov);
+  if (st.markov_hits == 0 || st.markov_coverage <= 0.0) {
+    throw vt::exception() << "repeated chains were not prefetched";
+  }
+
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
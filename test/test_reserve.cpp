@@ -0,0 +1,153 @@
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "exception.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 64;
+
+auto reserve(int fd, size_t off, size_t len) -> std::vector<iovec> {
+  std::vector<iovec> iov(16);  // NOLINT
+  const int n = vtpc_write_reserve(fd, static_cast<off_t>(off), len, iov.data(),
+                                   static_cast<int>(iov.size()));
+  if (n <= 0) {
+    throw vt::exception() << "vtpc_write_reserve failed at " << off;
+  }
+  iov.resize(static_cast<size_t>(n));
+  size_t total = 0;
+  for (const iovec& v : iov) total += v.iov_len;
+  if (total != len) {
+    throw vt::exception() << "reserved " << total << " of " << len << " bytes";
+  }
+  return iov;
+}
+
+// Write c over the first len bytes of the reservation.
+auto fill(const std::vector<iovec>& iov, char c, size_t len) -> void {
+  for (const iovec& v : iov) {
+    const size_t n = std::min(len, v.iov_len);
+    std::memset(v.iov_base, c, n);
+    len -= n;
+  }
+}
+
+auto read_all(int fd, size_t size) -> std::string {
+  std::string buf(size + block, 'x');
+  vtpc_lseek(fd, 0, SEEK_SET);
+  const ssize_t got = vtpc_read(fd, buf.data(), buf.size());
+  if (got != static_cast<ssize_t>(size)) {
+    throw vt::exception() << "vtpc_read returned " << got;
+  }
+  buf.resize(size);
+  return buf;
+}
+
+auto commit(int fd, size_t off, size_t len) -> void {
+  if (vtpc_write_commit(fd, static_cast<off_t>(off), len) != 0) {
+    throw vt::exception() << "vtpc_write_commit failed at " << off;
+  }
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file(blocks * block, '\0');
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  {
+    const int fd = vtpc_open("/tmp/b", O_CREAT | O_RDWR, 0644);
+    if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+      throw vt::exception() << "setup failed";
+    }
+    vtpc_close(fd);
+  }
+  vtpc_opts opts{};
+  opts.capacity = 256 * block;
+  opts.block_size = block;
+  const int fd = vtpc_open_ex("/tmp/b", O_RDWR, 0, &opts);
+  if (fd < 0) {
+    throw vt::exception() << "vtpc_open_ex failed";
+  }
+
+  // blocks overwritten whole are handed out zeroed, not read
+  std::vector<iovec> iov = reserve(fd, 2 * block, 4 * block);
+  for (const iovec& v : iov) {
+    const std::string got(static_cast<const char*>(v.iov_base), v.iov_len);
+    if (got != std::string(v.iov_len, '\0')) {
+      throw vt::exception() << "a whole block was read";
+    }
+  }
+  fill(iov, 'R', 4 * block);
+  commit(fd, 2 * block, 4 * block);
+  file.replace(2 * block, 4 * block, 4 * block, 'R');
+
+  // partial blocks are read; what is left uncommitted keeps the file's bytes
+  iov = reserve(fd, 10 * block + 100, 2 * block);  // NOLINT
+  if (std::string(static_cast<const char*>(iov[0].iov_base), 10) != file.substr(10 * block + 100, 10)) {  // NOLINT
+    throw vt::exception() << "a partial block was not read";
+  }
+  fill(iov, 'S', block);
+  commit(fd, 10 * block + 100, block);  // NOLINT
+  file.replace(10 * block + 100, block, block, 'S');  // NOLINT
+
+  // a cancelled reservation changes nothing
+  iov = reserve(fd, 20 * block, 4 * block);  // NOLINT
+  commit(fd, 20 * block, 0);  // NOLINT
+
+  // past EOF: the file grows
+  iov = reserve(fd, blocks * block, 1000);  // NOLINT
+  fill(iov, 'T', 1000);  // NOLINT
+  if (vtpc_write_reserve(fd, 0, 1, iov.data(), 1) == 0 || errno != EBUSY) {
+    throw vt::exception() << "second reservation accepted";
+  }
+  if (vtpc_write_commit(fd, blocks * block + 500, 1000) == 0 || errno != EINVAL) {  // NOLINT
+    throw vt::exception() << "commit past the reservation accepted";
+  }
+  commit(fd, blocks * block, 1000);  // NOLINT
+  file.append(1000, 'T');  // NOLINT
+
+  if (read_all(fd, file.size()) != file) {
+    throw vt::exception() << "wrong data through the cache";
+  }
+  std::vector<iovec> big(64);  // NOLINT
+  if (vtpc_write_reserve(fd, 0, blocks * block, big.data(), 64) != -1 || errno != ENOMEM) {  // NOLINT
+    throw vt::exception() << "reservation over the pin budget accepted";
+  }
+  if (vtpc_close(fd) != 0) {
+    throw vt::exception() << "vtpc_close failed";
+  }
+
+  std::string disk(file.size() + 1, '\0');
+  const int os = ::open("/tmp/b", O_RDONLY);
+  const ssize_t got = ::pread(os, disk.data(), disk.size(), 0);
+  ::close(os);
+  disk.resize(static_cast<size_t>(std::max<ssize_t>(got, 0)));
+  if (disk != file) {
+    throw vt::exception() << "wrong data on disk";
+  }
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}
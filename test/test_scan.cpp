@@ -0,0 +1,124 @@
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "exception.hpp"
+#include "file.hpp"
+
+extern "C" {
+#include "vtpc.h"
+}
+
+namespace {
+
+constexpr size_t block = 4096;
+constexpr size_t blocks = 256;
+
+auto contents() -> std::string {
+  std::string data(blocks * block - 100, '\0');  // NOLINT
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>('a' + (i / block + i) % 26);  // NOLINT
+  }
+  return data;
+}
+
+struct collect {
+  std::string out;
+  off_t next = 0;
+  size_t calls = 0;
+};
+
+auto append(const void* data, size_t len, off_t offset, void* ctx) -> int {
+  auto* c = static_cast<collect*>(ctx);
+  if (offset != c->next) {
+    return -2;
+  }
+  c->out.append(static_cast<const char*>(data), len);
+  c->next = offset + static_cast<off_t>(len);
+  c->calls++;
+  return 0;
+}
+
+auto scan(int fd, size_t off, size_t len, unsigned flags = 0) -> std::string {
+  collect c;
+  c.next = static_cast<off_t>(off);
+  if (vtpc_scan(fd, static_cast<off_t>(off), len, append, &c, flags) != 0) {
+    throw vt::exception() << "vtpc_scan(" << off << ", " << len << ") failed";
+  }
+  return c.out;
+}
+
+}  // namespace
+
+auto main() -> int try {
+  std::filesystem::remove("/tmp/b");
+  std::string file = contents();
+  vtpc_opts opts{};
+  opts.capacity = 64 * block;
+  opts.block_size = block;
+  opts.extent_pages = 1;
+  const int fd = vtpc_open_ex("/tmp/b", O_CREAT | O_RDWR, 0644, &opts);
+  if (fd < 0 || vtpc_write(fd, file.data(), file.size()) != static_cast<ssize_t>(file.size())) {
+    throw vt::exception() << "setup failed";
+  }
+  vtpc_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+  // a few blocks resident, one of them dirty
+  std::string buf(10 * block, 'x');  // NOLINT
+  vtpc_lseek(fd, 10 * block, SEEK_SET);  // NOLINT
+  vtpc_read(fd, buf.data(), buf.size());
+  vtpc_lseek(fd, 15 * block + 7, SEEK_SET);  // NOLINT
+  vtpc_write(fd, "dirty", 5);                // NOLINT
+  file.replace(15 * block + 7, 5, "dirty");  // NOLINT
+
+  const vtpc_stats before = vt::stats(fd);
+  if (scan(fd, 0, file.size()) != file) {
+    throw vt::exception() << "wrong data";
+  }
+  const vtpc_stats after = vt::stats(fd);
+  if (after.hits != before.hits || after.misses != before.misses ||
+      after.resident_bytes != before.resident_bytes || after.evictions != before.evictions) {
+    throw vt::exception() << "the scan changed the cache";
+  }
+  if (after.scan_reads == 0) {
+    throw vt::exception() << "nothing read ahead";
+  }
+
+  // unaligned ranges, and past EOF
+  if (scan(fd, 1000, 5 * block + 3) != file.substr(1000, 5 * block + 3)) {  // NOLINT
+    throw vt::exception() << "wrong data in an unaligned range";
+  }
+  if (scan(fd, file.size() - 10, 1000) != file.substr(file.size() - 10) ||  // NOLINT
+      !scan(fd, file.size(), block).empty()) {
+    throw vt::exception() << "wrong data at EOF";
+  }
+
+  // a callback stops the scan with its own value
+  auto stop = [](const void*, size_t, off_t, void*) -> int { return 7; };  // NOLINT
+  if (vtpc_scan(fd, 0, file.size(), stop, nullptr, 0) != 7) {  // NOLINT
+    throw vt::exception() << "the callback did not stop the scan";
+  }
+
+  // asked to, resident blocks count as read
+  const unsigned long long hits = vt::stats(fd).hits;
+  scan(fd, 10 * block, 10 * block, VTPC_SCAN_TOUCH);  // NOLINT
+  if (vt::stats(fd).hits != hits + 10) {              // NOLINT
+    throw vt::exception() << "touch: " << vt::stats(fd).hits - hits << " hits";
+  }
+  if (vtpc_scan(fd, 0, block, nullptr, nullptr, 0) == 0 || errno != EINVAL) {
+    throw vt::exception() << "no callback accepted";
+  }
+
+  vtpc_close(fd);
+  std::filesystem::remove("/tmp/b");
+  return 0;
+} catch (const std::exception& e) {
+  std::cerr << "exception: " << e.what() << '\n';
+  return 1;
+}